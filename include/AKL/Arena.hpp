@@ -0,0 +1,89 @@
+#ifndef AK_ARENA_H
+#define AK_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        struct ArenaStats
+        {
+            size_t reservedBytes;   // held from the heap by all arenas, cached or not
+            size_t inUseBytes;      // handed out to record buffers right now
+            size_t highWaterBytes;  // the most inUseBytes has ever been
+            size_t heapAllocations; // malloc calls made by arenas since startup
+        };
+
+        // Per-thread pool the record buffers grow into once a message outgrows their inline
+        // block. Blocks come in power-of-two size classes: the small ones are carved from
+        // fixed-size slabs, the large ones are allocated on their own, and released blocks
+        // go on a free list per class, so a thread's steady state makes no heap allocations.
+        // Everything is returned to the heap when the thread exits.
+        class RecordArena
+        {
+        public:
+            static const size_t SLAB_SIZE = 64 * 1024;
+            static const size_t MIN_BLOCK = 2 * 1024;
+            static const size_t CLASS_COUNT = 16;
+            static const size_t MAX_BLOCK = MIN_BLOCK << (CLASS_COUNT - 1);
+
+            // Large blocks kept cached per class; further releases go back to the heap.
+            static const size_t MAX_CACHED_LARGE = 2;
+
+            // The calling thread's arena. Record buffers look it up when they are constructed
+            // so it outlives them during thread exit.
+            static RecordArena& local();
+
+            RecordArena();
+            ~RecordArena();
+
+            RecordArena(const RecordArena&) = delete;
+            RecordArena& operator=(const RecordArena&) = delete;
+
+            // Returns a block of at least size bytes and stores its real size in granted, or
+            // nullptr when size exceeds MAX_BLOCK or the heap is exhausted.
+            void* acquire(size_t size, size_t& granted);
+
+            // Takes back a block from acquire() along with the size it granted.
+            void release(void* block, size_t granted);
+
+            ArenaStats stats() const;
+
+        private:
+            struct FreeBlock
+            {
+                FreeBlock* next;
+            };
+
+            struct alignas(16) Slab
+            {
+                Slab* next;
+            };
+
+            static size_t sizeClass(size_t size);
+            static size_t classSize(size_t index);
+
+            void* carve(size_t size);
+            void* allocate(size_t size);
+            void track(intptr_t inUse);
+
+            FreeBlock* freeLists[CLASS_COUNT];
+            size_t cached[CLASS_COUNT];
+            Slab* slabs;
+            char* slabCursor;
+            size_t slabRemaining;
+
+            size_t reservedBytes;
+            size_t inUseBytes;
+            size_t highWaterBytes;
+            size_t heapAllocations;
+        };
+
+        // Totals over every thread's arena; the high-water mark is process-wide.
+        ArenaStats getArenaStats();
+    }
+}
+
+#endif // AK_ARENA_H
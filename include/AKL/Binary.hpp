@@ -0,0 +1,94 @@
+#ifndef AK_BINARY_H
+#define AK_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Format.hpp"
+
+// Binary log stream, written in host byte order:
+//
+//   header:  "AKLB" u8 version
+//   format:  u8 'F', u32 id, u8 wide, u8 argCount, u8 argTypes[argCount], u32 length, UTF-8 text
+//   record:  u8 'R', u8 level, u32 id, i64 timestamp (us), u32 payloadSize, payload
+//
+// A format entry always precedes the first record that uses its id. The payload holds the
+// raw arguments in order: ARG_INT32/ARG_CHAR/ARG_WCHAR as 4 bytes, ARG_INT64/ARG_POINTER/
+// ARG_DOUBLE as 8 bytes, strings as a u32 byte length (BINARY_NULL_STRING for null) followed
+// by UTF-8 bytes. ARG_IGNORED (%n) consumes an argument but stores nothing.
+
+namespace AK
+{
+    namespace Log
+    {
+        static const char BINARY_MAGIC[4] = { 'A', 'K', 'L', 'B' };
+        static const uint8_t BINARY_VERSION = 1;
+        static const uint8_t BINARY_ENTRY_FORMAT = 'F';
+        static const uint8_t BINARY_ENTRY_RECORD = 'R';
+        static const uint32_t BINARY_NULL_STRING = 0xFFFFFFFF;
+        static const uint32_t BINARY_INVALID_ID = 0xFFFFFFFF;
+
+        static const size_t BINARY_MAX_FORMATS = 8192;
+        static const size_t BINARY_MAX_ARGS = 32;
+
+        enum BinaryArgType
+        {
+            ARG_INT32,
+            ARG_INT64,
+            ARG_DOUBLE,
+            ARG_LONG_DOUBLE,
+            ARG_POINTER,
+            ARG_CHAR,
+            ARG_WCHAR,
+            ARG_STRING,
+            ARG_WSTRING,
+            ARG_IGNORED,
+            ARG_NONE
+        };
+
+        // The argument type a conversion consumes from a va_list. Wide format strings follow
+        // the platform's wprintf rules: on Windows %s and %c take wide arguments there.
+        inline BinaryArgType conversionArgType(const ConversionSpec& spec, bool wide)
+        {
+            const char* length = spec.lengthModifier;
+            bool isLong = length[0] == 'l' && length[1] == '\0';
+            bool isWideDefault = false;
+
+            #if defined(_WIN32) || defined(_WIN64)
+            isWideDefault = wide;
+            #else
+            (void)wide;
+            #endif
+
+            switch (spec.conversion)
+            {
+                case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+                    if (length[0] == 'l' && length[1] == 'l') return ARG_INT64;
+                    if (length[0] == 'q' || length[0] == 'L') return ARG_INT64;
+                    if (isLong) return sizeof(long) == 8 ? ARG_INT64 : ARG_INT32;
+                    if (length[0] == 'j') return sizeof(intmax_t) == 8 ? ARG_INT64 : ARG_INT32;
+                    if (length[0] == 'z') return sizeof(size_t) == 8 ? ARG_INT64 : ARG_INT32;
+                    if (length[0] == 't') return sizeof(ptrdiff_t) == 8 ? ARG_INT64 : ARG_INT32;
+                    return ARG_INT32;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    return length[0] == 'L' ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+                case 'c':
+                    return isLong || isWideDefault ? ARG_WCHAR : ARG_CHAR;
+                case 'C':
+                    return ARG_WCHAR;
+                case 's':
+                    if (length[0] == 'h') return ARG_STRING;
+                    return isLong || isWideDefault ? ARG_WSTRING : ARG_STRING;
+                case 'S':
+                    return isWideDefault ? ARG_STRING : ARG_WSTRING;
+                case 'p':
+                    return ARG_POINTER;
+                case 'n':
+                    return ARG_IGNORED;
+                default:
+                    return ARG_NONE;
+            }
+        }
+    }
+}
+
+#endif // AK_BINARY_H
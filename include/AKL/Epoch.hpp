@@ -0,0 +1,34 @@
+#ifndef AK_EPOCH_H
+#define AK_EPOCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        // Epoch-based reclamation for the logger's configuration snapshots. Readers bracket
+        // their use of a snapshot with an EpochGuard, which costs two stores and a load and
+        // never waits. Writers publish a replacement and retire() the old one; it is freed
+        // once every reader that entered before the swap has left. Guards nest.
+        class EpochGuard
+        {
+        public:
+            EpochGuard();
+            ~EpochGuard();
+
+            EpochGuard(const EpochGuard&) = delete;
+            EpochGuard& operator=(const EpochGuard&) = delete;
+        };
+
+        // Hands object to destroy once no reader can still be using it. Call only after the
+        // pointer readers load has been replaced.
+        void retire(void* object, void (*destroy)(void*));
+
+        // Frees the retired objects that are no longer reachable and returns how many remain.
+        size_t reclaim();
+    }
+}
+
+#endif // AK_EPOCH_H
@@ -0,0 +1,301 @@
+#ifndef AK_FORMAT_H
+#define AK_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <wchar.h>
+#include <string_view>
+#include <type_traits>
+#include "RecordBuffer.hpp"
+#include "Utf8.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        // One printf conversion: '%' [flags] [width] [.precision] [length] conversion.
+        struct ConversionSpec
+        {
+            size_t length;
+            size_t optionsStart;
+            size_t optionsLength;
+            bool widthStar;
+            bool precisionStar;
+            char lengthModifier[3];
+            char conversion;
+        };
+
+        // Parses the conversion starting at fmt[0] == '%'. Returns false at an unterminated
+        // conversion at the end of the string.
+        template<typename CharT>
+        constexpr bool parseConversion(const CharT* fmt, ConversionSpec& spec)
+        {
+            size_t i = 1;
+            spec.widthStar = false;
+            spec.precisionStar = false;
+            spec.lengthModifier[0] = '\0';
+            spec.optionsStart = 1;
+
+            while (fmt[i] == '-' || fmt[i] == '+' || fmt[i] == ' ' || fmt[i] == '#' || fmt[i] == '0' || fmt[i] == '\'') i++;
+
+            if (fmt[i] == '*')
+            {
+                spec.widthStar = true;
+                i++;
+            }
+            while (fmt[i] >= '0' && fmt[i] <= '9') i++;
+
+            if (fmt[i] == '.')
+            {
+                i++;
+                if (fmt[i] == '*')
+                {
+                    spec.precisionStar = true;
+                    i++;
+                }
+                while (fmt[i] >= '0' && fmt[i] <= '9') i++;
+            }
+
+            spec.optionsLength = i - spec.optionsStart;
+
+            if ((fmt[i] == 'h' || fmt[i] == 'l') && fmt[i + 1] == fmt[i])
+            {
+                spec.lengthModifier[0] = spec.lengthModifier[1] = (char)fmt[i];
+                spec.lengthModifier[2] = '\0';
+                i += 2;
+            }
+            else if (fmt[i] == 'h' || fmt[i] == 'l' || fmt[i] == 'j' || fmt[i] == 'z' ||
+                     fmt[i] == 't' || fmt[i] == 'L' || fmt[i] == 'q')
+            {
+                spec.lengthModifier[0] = (char)fmt[i];
+                spec.lengthModifier[1] = '\0';
+                i++;
+            }
+
+            if (fmt[i] == 0) return false;
+
+            spec.conversion = (char)fmt[i];
+            spec.length = i + 1;
+            return true;
+        }
+
+        enum FormatArgType
+        {
+            FORMAT_ARG_BOOL,
+            FORMAT_ARG_CHAR,
+            FORMAT_ARG_INT,
+            FORMAT_ARG_UINT,
+            FORMAT_ARG_DOUBLE,
+            FORMAT_ARG_STRING,
+            FORMAT_ARG_WSTRING,
+            FORMAT_ARG_POINTER,
+            FORMAT_ARG_NONE
+        };
+
+        // A log argument captured by value behind a type tag, so formatting needs neither
+        // va_arg nor a template instantiation per call site. Strings are referenced and must
+        // stay alive until the record is rendered.
+        struct FormatArg
+        {
+            FormatArgType type;
+            uint32_t size;
+            union
+            {
+                int64_t i;
+                uint64_t u;
+                double d;
+                const void* pointer;
+                const char* text;
+                const wchar_t* textW;
+            };
+            size_t length;
+        };
+
+        template<typename T>
+        constexpr FormatArgType formatArgType()
+        {
+            if constexpr (std::is_same<T, bool>::value) return FORMAT_ARG_BOOL;
+            else if constexpr (std::is_same<T, char>::value || std::is_same<T, wchar_t>::value ||
+                               std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value) return FORMAT_ARG_CHAR;
+            else if constexpr (std::is_enum<T>::value) return std::is_signed<typename std::underlying_type<T>::type>::value ? FORMAT_ARG_INT : FORMAT_ARG_UINT;
+            else if constexpr (std::is_integral<T>::value) return std::is_signed<T>::value ? FORMAT_ARG_INT : FORMAT_ARG_UINT;
+            else if constexpr (std::is_floating_point<T>::value) return FORMAT_ARG_DOUBLE;
+            else if constexpr (std::is_convertible<const T&, const char*>::value || std::is_convertible<const T&, std::string_view>::value) return FORMAT_ARG_STRING;
+            else if constexpr (std::is_convertible<const T&, const wchar_t*>::value || std::is_convertible<const T&, std::wstring_view>::value) return FORMAT_ARG_WSTRING;
+            else if constexpr (std::is_pointer<T>::value) return FORMAT_ARG_POINTER;
+            else return FORMAT_ARG_NONE;
+        }
+
+        template<typename T>
+        inline FormatArg makeFormatArg(const T& value)
+        {
+            constexpr FormatArgType type = formatArgType<T>();
+            static_assert(type != FORMAT_ARG_NONE, "unsupported log argument type");
+
+            FormatArg arg;
+            arg.type = type;
+            arg.size = (uint32_t)sizeof(T);
+            arg.length = 0;
+
+            if constexpr (type == FORMAT_ARG_BOOL || type == FORMAT_ARG_CHAR || type == FORMAT_ARG_INT) arg.i = (int64_t)value;
+            else if constexpr (type == FORMAT_ARG_UINT) arg.u = (uint64_t)value;
+            else if constexpr (type == FORMAT_ARG_DOUBLE) arg.d = (double)value;
+            else if constexpr (type == FORMAT_ARG_STRING)
+            {
+                if constexpr (std::is_convertible<const T&, const char*>::value)
+                {
+                    arg.text = value;
+                    arg.length = arg.text != nullptr ? strlen(arg.text) : 0;
+                }
+                else
+                {
+                    std::string_view view = value;
+                    arg.text = view.data();
+                    arg.length = view.size();
+                }
+            }
+            else if constexpr (type == FORMAT_ARG_WSTRING)
+            {
+                if constexpr (std::is_convertible<const T&, const wchar_t*>::value)
+                {
+                    arg.textW = value;
+                    arg.length = arg.textW != nullptr ? wcslen(arg.textW) : 0;
+                }
+                else
+                {
+                    std::wstring_view view = value;
+                    arg.textW = view.data();
+                    arg.length = view.size();
+                }
+            }
+            else arg.pointer = (const void*)value;
+
+            return arg;
+        }
+
+        template<typename... Args>
+        struct FormatArgTypes
+        {
+            static constexpr size_t count = sizeof...(Args);
+            static constexpr FormatArgType types[sizeof...(Args) + 1] = { formatArgType<Args>()..., FORMAT_ARG_NONE };
+        };
+
+        // Only used inside decltype to turn a macro's argument list into FormatArgTypes.
+        template<typename... Args>
+        FormatArgTypes<typename std::decay<Args>::type...> formatArgTypes(const Args&...);
+
+        constexpr bool isIntegralArg(FormatArgType type)
+        {
+            return type == FORMAT_ARG_BOOL || type == FORMAT_ARG_CHAR || type == FORMAT_ARG_INT || type == FORMAT_ARG_UINT;
+        }
+
+        // The printf conversions the typed formatter renders; any other '%' prints as is.
+        constexpr bool isFormatConversion(char conversion)
+        {
+            switch (conversion)
+            {
+                case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c': case 'C':
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                case 's': case 'S': case 'p': case 'n':
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        constexpr bool conversionAccepts(char conversion, FormatArgType type)
+        {
+            switch (conversion)
+            {
+                case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c': case 'C':
+                    return isIntegralArg(type);
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    return type == FORMAT_ARG_DOUBLE;
+                case 's': case 'S':
+                    return type == FORMAT_ARG_STRING || type == FORMAT_ARG_WSTRING;
+                case 'p':
+                    return type == FORMAT_ARG_POINTER || type == FORMAT_ARG_STRING || type == FORMAT_ARG_WSTRING;
+                default:
+                    return false;
+            }
+        }
+
+        // Format strings take "{}" placeholders and printf conversions in any mix, each
+        // consuming the next argument ("{{", "}}" and "%%" are escapes). The check passes when
+        // every argument is consumed exactly once by a conversion that accepts its type. Since
+        // the type is known, length modifiers are not checked; h and hh still narrow integers
+        // as printf does.
+        template<typename ArgTypes, typename CharT>
+        constexpr bool checkFormat(const CharT* text)
+        {
+            size_t next = 0;
+
+            for (size_t i = 0; text[i] != 0; i++)
+            {
+                if (text[i] == '{' || text[i] == '}')
+                {
+                    if (text[i + 1] == text[i])
+                    {
+                        i++;
+                    }
+                    else if (text[i] == '{' && text[i + 1] == '}')
+                    {
+                        if (next++ >= ArgTypes::count) return false;
+                        i++;
+                    }
+                    continue;
+                }
+
+                if (text[i] != '%') continue;
+
+                if (text[i + 1] == '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                ConversionSpec spec = {};
+                if (!parseConversion(text + i, spec)) break;
+                if (!isFormatConversion(spec.conversion)) continue;
+                if (spec.conversion == 'n') return false;
+
+                if (spec.widthStar && (next >= ArgTypes::count || !isIntegralArg(ArgTypes::types[next++]))) return false;
+                if (spec.precisionStar && (next >= ArgTypes::count || !isIntegralArg(ArgTypes::types[next++]))) return false;
+                if (next >= ArgTypes::count || !conversionAccepts(spec.conversion, ArgTypes::types[next++])) return false;
+
+                i += spec.length - 1;
+            }
+
+            return next == ArgTypes::count;
+        }
+
+        template<bool Valid, typename CharT>
+        constexpr const CharT* checkedFormat(const CharT* text)
+        {
+            static_assert(Valid, "log format string does not match its arguments");
+            return text;
+        }
+
+        static const size_t FORMAT_MAX_VARARGS = 64;
+
+        // Renders text with the captured arguments; wide text rendered into a narrow buffer
+        // comes out as UTF-8. Placeholders without an argument are printed as written and
+        // surplus arguments are ignored.
+        void formatMessage(RecordBuffer<char>& out, const char* text, const FormatArg* args, size_t count);
+        void formatMessage(RecordBuffer<char>& out, const wchar_t* text, const FormatArg* args, size_t count);
+        void formatMessage(RecordBuffer<wchar_t>& out, const wchar_t* text, const FormatArg* args, size_t count);
+
+        // Renders one argument the way "{}" does.
+        void formatArg(RecordBuffer<char>& out, const FormatArg& arg);
+
+        // Renders a printf format and its va_list with the same formatter, so the result does
+        // not depend on the C locale. Returns false without writing anything when the format
+        // has more than FORMAT_MAX_VARARGS arguments.
+        bool formatVarArgs(RecordBuffer<char>& out, const char* text, va_list args);
+        bool formatVarArgs(RecordBuffer<char>& out, const wchar_t* text, va_list args);
+    }
+}
+
+#endif // AK_FORMAT_H
@@ -4,6 +4,17 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <wchar.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Format.hpp"
+#include "RingBuffer.hpp"
+#include "Sink.hpp"
+#include "Epoch.hpp"
+#include "Structured.hpp"
+#include "Stats.hpp"
 
 #if defined(_WIN32) || defined(_WIN64)
 #define PLATFORM_WINDOWS
@@ -12,45 +23,219 @@
 #if defined(PLATFORM_WINDOWS)
 #include <Windows.h>
 #else
-#include <linux.h>
+#include <unistd.h>
 #endif
 
 #define WIDEN2(x) L ## x
 #define WIDEN(x) WIDEN2(x)
 #define WFILE WIDEN(__FILE__)
 
-#define LOG_TRACE(msg) AK::Log::Logger::get()->logTrace(msg)
-#define LOG_DEBUG(msg) AK::Log::Logger::get()->logDebug(msg)
-#define LOG_INFO(msg) AK::Log::Logger::get()->logInfo(msg)
-#define LOG_WARNING(msg) AK::Log::Logger::get()->logWarning(msg)
-#define LOG_ERROR(msg) AK::Log::Logger::get()->logError(msg)
-#define LOG_FATAL(msg) AK::Log::Logger::get()->logFatal(msg)
-
-#define LOG_TRACE_ARGS(msg, ...) AK::Log::Logger::get()->logTrace(msg, __VA_ARGS__)
-#define LOG_DEBUG_ARGS(msg, ...) AK::Log::Logger::get()->logDebug(msg, __VA_ARGS__)
-#define LOG_INFO_ARGS(msg, ...) AK::Log::Logger::get()->logInfo(msg, __VA_ARGS__)
-#define LOG_WARNING_ARGS(msg, ...) AK::Log::Logger::get()->logWarning(msg, __VA_ARGS__)
-#define LOG_ERROR_ARGS(msg, ...) AK::Log::Logger::get()->logError(msg, __VA_ARGS__)
-#define LOG_FATAL_ARGS(msg, ...) AK::Log::Logger::get()->logFatal(msg, __VA_ARGS__)
-
-#define LOG_TRACE_WIDE(msg) AK::Log::Logger::get()->logTraceW(msg)
-#define LOG_DEBUG_WIDE(msg) AK::Log::Logger::get()->logDebugW(msg)
-#define LOG_INFO_WIDE(msg) AK::Log::Logger::get()->logInfoW(msg)
-#define LOG_WARNING_WIDE(msg) AK::Log::Logger::get()->logWarningW(msg)
-#define LOG_ERROR_WIDE(msg) AK::Log::Logger::get()->logErrorW(msg)
-#define LOG_FATAL_WIDE(msg) AK::Log::Logger::get()->logFatalW(msg)
-
-#define LOG_TRACE_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logTraceW(msg, __VA_ARGS__)
-#define LOG_DEBUG_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logDebugW(msg, __VA_ARGS__)
-#define LOG_INFO_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logInfoW(msg, __VA_ARGS__)
-#define LOG_WARNING_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logWarningW(msg, __VA_ARGS__)
-#define LOG_ERROR_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logErrorW(msg, __VA_ARGS__)
-#define LOG_FATAL_ARGS_WIDE(msg, ...) AK::Log::Logger::get()->logFatalW(msg, __VA_ARGS__)
-
-#define LOG_ASSERT(condition, msg) if (!(condition)) AK::Log::Logger::get()->logAssert("['%s':%d]: " msg, __FILE__, __LINE__)
-#define LOG_ASSERT_WIDE(condition, msg) if (!(condition)) AK::Log::Logger::get()->logAssertW(L"['%s':%d]: " msg, WFILE, __LINE__)
-#define LOG_ASSERT_ARGS(condition, msg, ...) if (!(condition)) AK::Log::Logger::get()->logAssert("['%s':%d]: " msg, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_ASSERT_ARGS_WIDE(condition, msg, ...) if (!(condition)) AK::Log::Logger::get()->logAssertW(L"['%s':%d]: " msg, WFILE, __LINE__, __VA_ARGS__)
+#define AKL_LEVEL_TRACE 0
+#define AKL_LEVEL_DEBUG 1
+#define AKL_LEVEL_INFO 2
+#define AKL_LEVEL_WARNING 3
+#define AKL_LEVEL_ERROR 4
+#define AKL_LEVEL_FATAL 5
+#define AKL_LEVEL_ASSERT 6
+
+// Call sites below AKL_MIN_LEVEL are compiled out entirely, e.g. -DAKL_MIN_LEVEL=AKL_LEVEL_INFO
+// for release builds.
+#ifndef AKL_MIN_LEVEL
+#define AKL_MIN_LEVEL AKL_LEVEL_TRACE
+#endif
+
+// Skips the call, including the evaluation of its arguments, when the level is below the
+// logger's threshold.
+#define AKL_LOG_IF(level) if (!AK::Log::Logger::get()->isEnabled(level)) {} else
+
+// The same for a named logger handle from Logger::get(name); logger is evaluated twice, so
+// pass a variable.
+#define AKL_LOG_IF_TO(logger, level) if (!(logger)->isEnabled(level)) {} else
+
+// AKL_LOG_IF plus the level's sampling policy from Logger::setSampling, used by the TRACE and
+// DEBUG macros; sampled-out calls skip their arguments too.
+#define AKL_SAMPLE_IF(level) if (!AK::Log::Logger::get()->isEnabled(level) || !AK::Log::Logger::sample(level)) {} else
+#define AKL_SAMPLE_IF_TO(logger, level) if (!(logger)->isEnabled(level) || !AK::Log::Logger::sample(level)) {} else
+
+// Keeps every rate-th call of this call site on each thread, whatever the level's policy.
+#define AKL_SAMPLE_SITE_IF(level, rate) if (!AK::Log::Logger::get()->isEnabled(level) || !AK::Log::Logger::sampleSite(rate, []() -> uint32_t& { static thread_local uint32_t countdown = 0; return countdown; }())) {} else
+
+// Fails to compile when the placeholders and conversions of msg do not match the argument
+// types; see checkFormat in Format.hpp.
+#define AKL_CHECKED_FORMAT(msg, ...) AK::Log::checkedFormat<AK::Log::checkFormat<decltype(AK::Log::formatArgTypes(__VA_ARGS__))>(msg)>(msg)
+
+// Registers a format string once per call site; the *_BINARY macros log only its id and the
+// raw arguments, leaving the formatting to akl-decode.
+#define AKL_FORMAT_ID(msg) ([]() { static const uint32_t id = AK::Log::Logger::registerFormat(msg); return id; }())
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_TRACE
+#define LOG_TRACE(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logTrace(msg)
+#define LOG_TRACE_ARGS(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_TRACE, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_TRACE_WIDE(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logTraceW(msg)
+#define LOG_TRACE_ARGS_WIDE(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_TRACE, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_TRACE_BINARY(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_TRACE, AKL_FORMAT_ID(msg), msg)
+#define LOG_TRACE_ARGS_BINARY(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_TRACE, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_TRACE_WIDE_BINARY(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_TRACE, AKL_FORMAT_ID(msg), msg)
+#define LOG_TRACE_ARGS_WIDE_BINARY(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_TRACE, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_TRACE_TO(logger, msg) AKL_SAMPLE_IF_TO(logger, AK::Log::LEVEL_TRACE) (logger)->logFormat(AK::Log::LEVEL_TRACE, msg)
+#define LOG_TRACE_ARGS_TO(logger, msg, ...) AKL_SAMPLE_IF_TO(logger, AK::Log::LEVEL_TRACE) (logger)->logFormat(AK::Log::LEVEL_TRACE, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_TRACE_KV(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_TRACE) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_TRACE, msg, __VA_ARGS__)
+#define LOG_TRACE_SAMPLED(rate, msg) AKL_SAMPLE_SITE_IF(AK::Log::LEVEL_TRACE, rate) AK::Log::Logger::get()->logTrace(msg)
+#define LOG_TRACE_ARGS_SAMPLED(rate, msg, ...) AKL_SAMPLE_SITE_IF(AK::Log::LEVEL_TRACE, rate) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_TRACE, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#else
+#define LOG_TRACE(msg) ((void)0)
+#define LOG_TRACE_ARGS(msg, ...) ((void)0)
+#define LOG_TRACE_WIDE(msg) ((void)0)
+#define LOG_TRACE_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_TRACE_BINARY(msg) ((void)0)
+#define LOG_TRACE_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_TRACE_WIDE_BINARY(msg) ((void)0)
+#define LOG_TRACE_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_TRACE_TO(logger, msg) ((void)0)
+#define LOG_TRACE_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_TRACE_KV(msg, ...) ((void)0)
+#define LOG_TRACE_SAMPLED(rate, msg) ((void)0)
+#define LOG_TRACE_ARGS_SAMPLED(rate, msg, ...) ((void)0)
+#endif
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_DEBUG
+#define LOG_DEBUG(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logDebug(msg)
+#define LOG_DEBUG_ARGS(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_DEBUG, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_DEBUG_WIDE(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logDebugW(msg)
+#define LOG_DEBUG_ARGS_WIDE(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_DEBUG, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_DEBUG_BINARY(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_DEBUG, AKL_FORMAT_ID(msg), msg)
+#define LOG_DEBUG_ARGS_BINARY(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_DEBUG, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_DEBUG_WIDE_BINARY(msg) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_DEBUG, AKL_FORMAT_ID(msg), msg)
+#define LOG_DEBUG_ARGS_WIDE_BINARY(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_DEBUG, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_DEBUG_TO(logger, msg) AKL_SAMPLE_IF_TO(logger, AK::Log::LEVEL_DEBUG) (logger)->logFormat(AK::Log::LEVEL_DEBUG, msg)
+#define LOG_DEBUG_ARGS_TO(logger, msg, ...) AKL_SAMPLE_IF_TO(logger, AK::Log::LEVEL_DEBUG) (logger)->logFormat(AK::Log::LEVEL_DEBUG, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_DEBUG_KV(msg, ...) AKL_SAMPLE_IF(AK::Log::LEVEL_DEBUG) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_DEBUG, msg, __VA_ARGS__)
+#define LOG_DEBUG_SAMPLED(rate, msg) AKL_SAMPLE_SITE_IF(AK::Log::LEVEL_DEBUG, rate) AK::Log::Logger::get()->logDebug(msg)
+#define LOG_DEBUG_ARGS_SAMPLED(rate, msg, ...) AKL_SAMPLE_SITE_IF(AK::Log::LEVEL_DEBUG, rate) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_DEBUG, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#else
+#define LOG_DEBUG(msg) ((void)0)
+#define LOG_DEBUG_ARGS(msg, ...) ((void)0)
+#define LOG_DEBUG_WIDE(msg) ((void)0)
+#define LOG_DEBUG_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_DEBUG_BINARY(msg) ((void)0)
+#define LOG_DEBUG_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_DEBUG_WIDE_BINARY(msg) ((void)0)
+#define LOG_DEBUG_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_DEBUG_TO(logger, msg) ((void)0)
+#define LOG_DEBUG_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_DEBUG_KV(msg, ...) ((void)0)
+#define LOG_DEBUG_SAMPLED(rate, msg) ((void)0)
+#define LOG_DEBUG_ARGS_SAMPLED(rate, msg, ...) ((void)0)
+#endif
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_INFO
+#define LOG_INFO(msg) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logInfo(msg)
+#define LOG_INFO_ARGS(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_INFO, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_INFO_WIDE(msg) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logInfoW(msg)
+#define LOG_INFO_ARGS_WIDE(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_INFO, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_INFO_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_INFO, AKL_FORMAT_ID(msg), msg)
+#define LOG_INFO_ARGS_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_INFO, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_INFO_WIDE_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_INFO, AKL_FORMAT_ID(msg), msg)
+#define LOG_INFO_ARGS_WIDE_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_INFO, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_INFO_TO(logger, msg) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_INFO) (logger)->logFormat(AK::Log::LEVEL_INFO, msg)
+#define LOG_INFO_ARGS_TO(logger, msg, ...) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_INFO) (logger)->logFormat(AK::Log::LEVEL_INFO, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_INFO_KV(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_INFO) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_INFO, msg, __VA_ARGS__)
+#else
+#define LOG_INFO(msg) ((void)0)
+#define LOG_INFO_ARGS(msg, ...) ((void)0)
+#define LOG_INFO_WIDE(msg) ((void)0)
+#define LOG_INFO_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_INFO_BINARY(msg) ((void)0)
+#define LOG_INFO_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_INFO_WIDE_BINARY(msg) ((void)0)
+#define LOG_INFO_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_INFO_TO(logger, msg) ((void)0)
+#define LOG_INFO_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_INFO_KV(msg, ...) ((void)0)
+#endif
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_WARNING
+#define LOG_WARNING(msg) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logWarning(msg)
+#define LOG_WARNING_ARGS(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_WARNING, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_WARNING_WIDE(msg) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logWarningW(msg)
+#define LOG_WARNING_ARGS_WIDE(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_WARNING, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_WARNING_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_WARNING, AKL_FORMAT_ID(msg), msg)
+#define LOG_WARNING_ARGS_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_WARNING, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_WARNING_WIDE_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_WARNING, AKL_FORMAT_ID(msg), msg)
+#define LOG_WARNING_ARGS_WIDE_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_WARNING, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_WARNING_TO(logger, msg) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_WARNING) (logger)->logFormat(AK::Log::LEVEL_WARNING, msg)
+#define LOG_WARNING_ARGS_TO(logger, msg, ...) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_WARNING) (logger)->logFormat(AK::Log::LEVEL_WARNING, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_WARNING_KV(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_WARNING) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_WARNING, msg, __VA_ARGS__)
+#else
+#define LOG_WARNING(msg) ((void)0)
+#define LOG_WARNING_ARGS(msg, ...) ((void)0)
+#define LOG_WARNING_WIDE(msg) ((void)0)
+#define LOG_WARNING_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_WARNING_BINARY(msg) ((void)0)
+#define LOG_WARNING_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_WARNING_WIDE_BINARY(msg) ((void)0)
+#define LOG_WARNING_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_WARNING_TO(logger, msg) ((void)0)
+#define LOG_WARNING_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_WARNING_KV(msg, ...) ((void)0)
+#endif
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_ERROR
+#define LOG_ERROR(msg) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logError(msg)
+#define LOG_ERROR_ARGS(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_ERROR, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_ERROR_WIDE(msg) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logErrorW(msg)
+#define LOG_ERROR_ARGS_WIDE(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_ERROR, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_ERROR_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_ERROR, AKL_FORMAT_ID(msg), msg)
+#define LOG_ERROR_ARGS_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_ERROR, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_ERROR_WIDE_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_ERROR, AKL_FORMAT_ID(msg), msg)
+#define LOG_ERROR_ARGS_WIDE_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_ERROR, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_ERROR_TO(logger, msg) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_ERROR) (logger)->logFormat(AK::Log::LEVEL_ERROR, msg)
+#define LOG_ERROR_ARGS_TO(logger, msg, ...) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_ERROR) (logger)->logFormat(AK::Log::LEVEL_ERROR, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_ERROR_KV(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_ERROR) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_ERROR, msg, __VA_ARGS__)
+#else
+#define LOG_ERROR(msg) ((void)0)
+#define LOG_ERROR_ARGS(msg, ...) ((void)0)
+#define LOG_ERROR_WIDE(msg) ((void)0)
+#define LOG_ERROR_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_ERROR_BINARY(msg) ((void)0)
+#define LOG_ERROR_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_ERROR_WIDE_BINARY(msg) ((void)0)
+#define LOG_ERROR_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_ERROR_TO(logger, msg) ((void)0)
+#define LOG_ERROR_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_ERROR_KV(msg, ...) ((void)0)
+#endif
+
+#if AKL_MIN_LEVEL <= AKL_LEVEL_FATAL
+#define LOG_FATAL(msg) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logFatal(msg)
+#define LOG_FATAL_ARGS(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_FATAL, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_FATAL_WIDE(msg) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logFatalW(msg)
+#define LOG_FATAL_ARGS_WIDE(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_FATAL, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_FATAL_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_FATAL, AKL_FORMAT_ID(msg), msg)
+#define LOG_FATAL_ARGS_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logBinary(AK::Log::LEVEL_FATAL, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_FATAL_WIDE_BINARY(msg) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_FATAL, AKL_FORMAT_ID(msg), msg)
+#define LOG_FATAL_ARGS_WIDE_BINARY(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logBinaryW(AK::Log::LEVEL_FATAL, AKL_FORMAT_ID(msg), msg, __VA_ARGS__)
+#define LOG_FATAL_TO(logger, msg) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_FATAL) (logger)->logFormat(AK::Log::LEVEL_FATAL, msg)
+#define LOG_FATAL_ARGS_TO(logger, msg, ...) AKL_LOG_IF_TO(logger, AK::Log::LEVEL_FATAL) (logger)->logFormat(AK::Log::LEVEL_FATAL, AKL_CHECKED_FORMAT(msg, __VA_ARGS__), __VA_ARGS__)
+#define LOG_FATAL_KV(msg, ...) AKL_LOG_IF(AK::Log::LEVEL_FATAL) AK::Log::Logger::get()->logKV(AK::Log::LEVEL_FATAL, msg, __VA_ARGS__)
+#else
+#define LOG_FATAL(msg) ((void)0)
+#define LOG_FATAL_ARGS(msg, ...) ((void)0)
+#define LOG_FATAL_WIDE(msg) ((void)0)
+#define LOG_FATAL_ARGS_WIDE(msg, ...) ((void)0)
+#define LOG_FATAL_BINARY(msg) ((void)0)
+#define LOG_FATAL_ARGS_BINARY(msg, ...) ((void)0)
+#define LOG_FATAL_WIDE_BINARY(msg) ((void)0)
+#define LOG_FATAL_ARGS_WIDE_BINARY(msg, ...) ((void)0)
+#define LOG_FATAL_TO(logger, msg) ((void)0)
+#define LOG_FATAL_ARGS_TO(logger, msg, ...) ((void)0)
+#define LOG_FATAL_KV(msg, ...) ((void)0)
+#endif
+
+#define LOG_ASSERT(condition, msg) if ((condition) || !AK::Log::Logger::get()->isEnabled(AK::Log::LEVEL_ASSERT)) {} else AK::Log::Logger::get()->logAssert("['%s':%d]: " msg, __FILE__, __LINE__)
+#define LOG_ASSERT_WIDE(condition, msg) if ((condition) || !AK::Log::Logger::get()->isEnabled(AK::Log::LEVEL_ASSERT)) {} else AK::Log::Logger::get()->logAssertW(L"['%s':%d]: " msg, WFILE, __LINE__)
+#define LOG_ASSERT_ARGS(condition, msg, ...) if ((condition) || !AK::Log::Logger::get()->isEnabled(AK::Log::LEVEL_ASSERT)) {} else AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_ASSERT, AKL_CHECKED_FORMAT("['%s':%d]: " msg, __FILE__, __LINE__, __VA_ARGS__), __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_ASSERT_ARGS_WIDE(condition, msg, ...) if ((condition) || !AK::Log::Logger::get()->isEnabled(AK::Log::LEVEL_ASSERT)) {} else AK::Log::Logger::get()->logFormat(AK::Log::LEVEL_ASSERT, AKL_CHECKED_FORMAT(L"['%s':%d]: " msg, WFILE, __LINE__, __VA_ARGS__), WFILE, __LINE__, __VA_ARGS__)
 
 namespace AK 
 {
@@ -67,6 +252,79 @@ namespace AK
             LEVEL_ASSERT
         };
 
+        enum TimePrecision
+        {
+            PRECISION_SECONDS,
+            PRECISION_MILLISECONDS,
+            PRECISION_MICROSECONDS
+        };
+
+        enum FormatTokenType
+        {
+            TOKEN_LITERAL,
+            TOKEN_LEVEL,
+            TOKEN_DATE,
+            TOKEN_TIME,
+            TOKEN_COLOR,
+            TOKEN_ENCODING,
+            TOKEN_SAMPLE_RATE,
+            TOKEN_MESSAGE
+        };
+
+        struct FormatToken
+        {
+            FormatTokenType type;
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        // A layout string compiled into literal runs and directives.
+        struct FormatProgram
+        {
+            static const size_t MAX_TOKENS = 32;
+
+            FormatToken tokens[MAX_TOKENS];
+            size_t count;
+        };
+
+        // Per-call metadata that travels with a record from the log call to the output, so
+        // concurrent callers never share mutable state on the Logger.
+        struct Record
+        {
+            WarningLevel level;
+            int64_t timestamp;
+            uint32_t sampleRate;
+            const char* fields;
+            uint32_t fieldsSize;
+        };
+
+        enum ColorMode
+        {
+            COLOR_AUTO,
+            COLOR_ALWAYS,
+            COLOR_NEVER
+        };
+
+        enum OutputFormat
+        {
+            OUTPUT_TEXT,
+            OUTPUT_JSON,
+            OUTPUT_LOGFMT
+        };
+
+        enum SamplingMode
+        {
+            SAMPLING_COUNTED,
+            SAMPLING_RANDOM
+        };
+
+        enum OverflowPolicy
+        {
+            OVERFLOW_BLOCK,
+            OVERFLOW_DROP_NEWEST,
+            OVERFLOW_DROP_OLDEST
+        };
+
         class Logger 
         {
         public:
@@ -104,47 +362,358 @@ namespace AK
             void setLevelW(WarningLevel _level);
             void printFmtW(const wchar_t* fmt, const wchar_t* text, ...);
             void printFmtArgsW(const wchar_t* fmt, const wchar_t* text, va_list args);
-            static Logger* get();
+            static Logger* get() { return &logger; }
+
+            // Named loggers form a dot-separated hierarchy under get(): "net.http" is a child of
+            // "net". A child inherits its parent's threshold until given its own and writes to
+            // its parent's sinks until it changes its own, and shares the root's async queue.
+            // Lookups are lock-free and the returned handle stays valid for the whole program;
+            // effective thresholds are precomputed whenever the configuration changes.
+            static Logger* get(const char* name);
+            const char* getName() const { return name; }
+            Logger* getParent() const { return parent; }
+            void inheritThreshold();
+            static int64_t currentTimestamp();
+
+            bool isEnabled(WarningLevel _level) const { return _level >= threshold.load(std::memory_order_relaxed); }
+            void setThreshold(WarningLevel _level);
+            WarningLevel getThreshold() const;
+
+            void setTimePrecision(TimePrecision precision);
+            void setSink(Sink* _sink);
+
+            // Replaces the layout pair of this logger and of the sinks using it while other
+            // threads keep logging; both strings must outlive the logger's use of them.
+            void setLayout(const char* layout, const wchar_t* layoutW);
+
+            // Applies a configuration file of "key = value" lines ('#' starts a comment):
+            //     level = WARNING              root threshold
+            //     net.http.level = DEBUG       a named logger's threshold, or "inherit"
+            //     layout = [%l %t]: %s\n       root layout, used for wide records too
+            //     time_precision = ms          s, ms or us
+            // Unknown keys and bad values are skipped; returns false if the file cannot be read.
+            static bool loadConfig(const char* path);
+
+            // Starts a thread that reloads path whenever requestReload() is called, which the
+            // SIGHUP handler this installs does on POSIX systems, and that frees retired
+            // configuration snapshots in the background.
+            static void watchConfig(const char* path);
+            static void stopWatching();
+            static void requestReload();
+
+            // Installs handlers for SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL that call
+            // emergencyFlush() and then pass the signal on to the handler they replaced. The
+            // handler runs on an alternate stack on the installing thread.
+            static void installCrashHandler();
+
+            // Writes out the records left in the async queue and then what the sinks still
+            // buffer, using only write(2): no locks, no allocation, no layouts. Queued records
+            // come out as "[LEVEL time] message key=value" lines, or minimal JSON or logfmt on
+            // structured sinks. The writer thread is stopped first and sinks write through from
+            // then on, for good. Meant for a dying process; flush() is the normal way.
+            static void emergencyFlush();
+
+            // Extra sinks next to the one set with setSink(), each with its own threshold, color
+            // policy and optionally its own layout pair (the logger's otherwise). A record is
+            // rendered once per distinct layout and shared by the sinks using it. Sinks and
+            // layouts are not owned and must outlive the logger's use of them.
+            static const size_t MAX_SINKS = 8;
+            bool addSink(Sink* _sink, WarningLevel _threshold);
+            bool addSink(Sink* _sink, WarningLevel _threshold, const char* layout, const wchar_t* layoutW, ColorMode colors);
+
+            // A sink that gets one JSON object or logfmt line per record instead of a layout:
+            // time, level, logger name, message, sample rate and the record's key/value fields.
+            bool addSink(Sink* _sink, WarningLevel _threshold, OutputFormat output);
+            void removeSink(Sink* _sink);
+            void setSinkThreshold(Sink* _sink, WarningLevel _threshold);
+
+            // Per-call-site rate limit, keyed by the format string pointer of the log call: a
+            // site may log burst records at once and perSecond on average after that. Records
+            // over the limit are dropped before they are formatted and counted; the count is
+            // logged as "last message repeated N times" when the site next gets through, or by
+            // flushSuppressed(), which flush() calls. 0 records per second, the default, turns
+            // limiting off.
+            static void setRateLimit(uint32_t perSecond, uint32_t burst);
+            static void flushSuppressed();
+
+            // Sampling for the LOG_TRACE* and LOG_DEBUG* macros: of the records of _level that
+            // pass the threshold only 1 in rate is kept, either every rate-th one on each thread
+            // (SAMPLING_COUNTED) or each with probability 1/rate from a per-thread generator
+            // (SAMPLING_RANDOM). The decision is made before the arguments are evaluated. Kept
+            // records carry the rate, which the %r layout directive prints, so counts can be
+            // scaled back up. A rate of 0 or 1 keeps every record.
+            static void setSampling(WarningLevel _level, uint32_t rate, SamplingMode mode);
+
+            static bool sample(WarningLevel _level)
+            {
+                uint32_t policy = samplingPolicy[_level].load(std::memory_order_relaxed);
+                if (policy == 0) return true;
+
+                SamplerState& state = samplerState();
+                uint32_t rate = policy & ~SAMPLING_RANDOM_BIT;
+
+                if ((policy & SAMPLING_RANDOM_BIT) != 0)
+                {
+                    // xorshift64, seeded from the state's address on the thread's first use
+                    uint64_t x = state.random != 0 ? state.random : (uint64_t)(uintptr_t)&state * 0x9E3779B97F4A7C15ull | 1;
+                    x ^= x >> 12;
+                    x ^= x << 25;
+                    x ^= x >> 27;
+                    state.random = x;
+
+                    if (((x >> 32) * rate >> 32) != 0) return false;
+                }
+                else if (state.countdown[_level] != 0)
+                {
+                    state.countdown[_level]--;
+                    return false;
+                }
+                else state.countdown[_level] = rate - 1;
+
+                state.rate = rate;
+                return true;
+            }
+
+            static bool sampleSite(uint32_t rate, uint32_t& countdown)
+            {
+                if (countdown != 0)
+                {
+                    countdown--;
+                    return false;
+                }
+
+                countdown = rate > 1 ? rate - 1 : 0;
+                samplerState().rate = rate > 1 ? rate : 0;
+                return true;
+            }
+
+            // Messages that do not fit a queue slot, fields included, are carried in a heap
+            // block of their own, so async output matches sync output. They are only cut to
+            // the slot when that allocation fails, which stats().truncated counts.
+            void startAsync(size_t capacity, OverflowPolicy policy);
+            void stopAsync();
+            void flush();
+            bool isAsync() const;
+            uint64_t droppedRecords() const;
+
+            // Counters about the logging itself, summed over all threads on each call; see
+            // LoggerStats. Cheap enough to poll every few seconds.
+            static LoggerStats stats();
+
+            // Logs a stats() snapshot as one key/value record at _level, once or every
+            // intervalSeconds from a background thread until stopStatsReport().
+            static void reportStats(WarningLevel _level);
+            static void startStatsReport(uint32_t intervalSeconds, WarningLevel _level);
+            static void stopStatsReport();
+
+            // Type-safe front end: "{}" placeholders and printf conversions, formatted without
+            // the C locale or va_arg. Use the LOG_*_ARGS macros to have the format checked at
+            // compile time.
+            template<typename CharT, typename... Args>
+            void logFormat(WarningLevel _level, const CharT* text, const Args&... args)
+            {
+                if (!isEnabled(_level)) return;
+
+                const FormatArg captured[sizeof...(Args) + 1] = { makeFormatArg(args)... };
+                logArgs(_level, text, captured, sizeof...(Args));
+            }
+
+            template<typename CharT, typename... Args>
+            void trace(const CharT* text, const Args&... args) { logFormat(LEVEL_TRACE, text, args...); }
+            template<typename CharT, typename... Args>
+            void debug(const CharT* text, const Args&... args) { logFormat(LEVEL_DEBUG, text, args...); }
+            template<typename CharT, typename... Args>
+            void info(const CharT* text, const Args&... args) { logFormat(LEVEL_INFO, text, args...); }
+            template<typename CharT, typename... Args>
+            void warning(const CharT* text, const Args&... args) { logFormat(LEVEL_WARNING, text, args...); }
+            template<typename CharT, typename... Args>
+            void error(const CharT* text, const Args&... args) { logFormat(LEVEL_ERROR, text, args...); }
+            template<typename CharT, typename... Args>
+            void fatal(const CharT* text, const Args&... args) { logFormat(LEVEL_FATAL, text, args...); }
+
+            // Structured records: a plain message followed by key/value pairs, e.g.
+            // logKV(LEVEL_INFO, "request done", "latency_us", latency, "status", code). Values
+            // are captured like logFormat arguments and become typed fields on OUTPUT_JSON and
+            // OUTPUT_LOGFMT sinks and key=value pairs after the message on text sinks.
+            template<typename... Args>
+            void logKV(WarningLevel _level, const char* text, const Args&... args)
+            {
+                static_assert(KeyValueArgs<typename std::decay<Args>::type...>::valid, "logKV takes string keys, each followed by its value");
+                if (!isEnabled(_level)) return;
+
+                const FormatArg captured[sizeof...(Args) + 1] = { makeFormatArg(args)... };
+                logFields(_level, text, captured, sizeof...(Args) / 2);
+            }
+
+            void logFields(WarningLevel _level, const char* text, const FormatArg* fields, size_t count);
+            void logArgs(WarningLevel _level, const char* text, const FormatArg* args, size_t count);
+            void logArgs(WarningLevel _level, const wchar_t* text, const FormatArg* args, size_t count);
+
+            static uint32_t registerFormat(const char* text);
+            static uint32_t registerFormat(const wchar_t* text);
+            void setBinarySink(Sink* _sink);
+            void logBinary(WarningLevel _level, uint32_t id, const char* text, ...);
+            void logBinaryW(WarningLevel _level, uint32_t id, const wchar_t* text, ...);
+
+            static const size_t ASYNC_TEXT_LENGTH = 256;
         private:
-            void printLevel();
-            void printLevelColor();
-            void printColor(int color);
+            struct SinkLayout
+            {
+                const char* fmt;
+                const wchar_t* fmtW;
+                OutputFormat output;
+                FormatProgram program;
+                FormatProgram programW;
+            };
+
+            struct SinkEntry
+            {
+                Sink* sink;
+                WarningLevel threshold;
+                bool colors;
+                uint32_t layout;
+            };
+
+            // The logger's configuration snapshot, immutable once published and read under an
+            // EpochGuard. Entry 0 is the setSink() sink and always uses layout 0, the logger's
+            // own. Replaced snapshots are retired and freed once their readers have left.
+            struct SinkTable
+            {
+                SinkEntry entries[MAX_SINKS];
+                size_t count;
+                SinkLayout layouts[MAX_SINKS];
+                size_t layoutCount;
+                WarningLevel lowest;
+                uint64_t generation;
+            };
+
+            // The entries of the table with that generation that took a record.
+            struct SinkSelection
+            {
+                uint64_t generation;
+                uint32_t entries;
+            };
+
+            // The calling thread's sampling state; rate is that of the record being logged and
+            // is taken by submit(), 0 when the record was not sampled.
+            struct SamplerState
+            {
+                uint64_t random;
+                uint32_t countdown[LEVEL_ASSERT + 1];
+                uint32_t rate;
+            };
+
+            static SamplerState& samplerState()
+            {
+                static thread_local SamplerState state;
+                return state;
+            }
+
+            static const uint32_t SAMPLING_RANDOM_BIT = 0x80000000u;
+
+            struct AsyncRecord
+            {
+                Logger* origin;
+                WarningLevel level;
+                int64_t timestamp;
+                uint32_t sampleRate;
+                SinkSelection selection;
+                bool wide;
+                uint32_t fieldsOffset;
+                uint32_t fieldsSize;
+                char* spill;
+                char text[ASYNC_TEXT_LENGTH];
+
+                // The message and packed fields, in spill when the slot was too small.
+                const char* data() const { return spill != nullptr ? spill : text; }
+            };
+
+            template<typename Render>
+            void submit(WarningLevel _level, bool wide, const void* site, const FormatArg* fields, size_t fieldCount, const Render& render);
+            bool admitSite(WarningLevel _level, const void* format, bool wide, uint64_t& repeats);
+            void reportRepeats(WarningLevel _level, const void* format, bool wide, uint64_t repeats);
+            template<typename Render>
+            bool pushAsync(Logger* origin, const Record& header, const SinkSelection& selection, bool wide, const Render& render);
+            void asyncWriter();
+            void writeRecord(const AsyncRecord& record);
+            void wakeWriter();
+            void defineFormats(Sink* target, uint32_t id);
+            void writeBinary(Sink* target, WarningLevel _level, uint32_t id, va_list args);
+
+            void printLevel(WarningLevel _level);
+            void printLevelColor(WarningLevel _level);
+            void printColor(const char* color);
+            void printColorCode(uint32_t code);
             void clearLevel();
-            char readChar(const char* fmt, size_t length, int i);
-            char* getCurrentTime(char* str);
-            char* getCurrentDate(char* str);
-
-            void printLevelW();
-            wchar_t readCharW(const wchar_t* fmt, size_t length, int i);
-            wchar_t* getCurrentTimeW(wchar_t* str);
-            wchar_t* getCurrentDateW(wchar_t* str);
+            template<typename Message>
+            bool emitMessage(const Record& record, bool wide, const SinkLayout* adhoc, const SinkSelection* selection, const Message& message);
+            template<typename Message>
+            void renderStructured(const Record& record, OutputFormat output, const Message& message);
+            template<typename CharT, typename Message>
+            void renderLayout(const Record& record, const CharT* layout, const FormatProgram& program, const Message& message);
+            Logger(Logger* _parent, const char* _name, uint32_t _hash);
+            static Logger* create(const char* _name, size_t length, uint32_t _hash);
+            static void refreshHierarchy();
+            static Logger* registered(size_t index);
+            static void emergencyRecord(const AsyncRecord& record);
+            bool inHierarchy() const { return parent != nullptr || this == &logger; }
+            void adoptSinks();
+            void initSinks();
+            SinkTable* copySinks();
+            void publishSinks(SinkTable* table);
+            static void destroySinks(void* table);
+            static uint32_t selectSinks(const SinkTable* table, const Record& record);
+            void flushSinks();
+            void printTime(int64_t timestamp);
+            void printSampleRate(uint32_t rate);
+            void printDate(int64_t timestamp);
+
             void ConvertWs(const char* src, wchar_t* dest);
 
-            const char* fmt;
-            const wchar_t* fmtW;
-            WarningLevel level;
-            char currentTime[10];
-            char currentDate[11];
-            wchar_t currentTimeW[10];
-            wchar_t currentDateW[11];
+            std::atomic<const char*> fmt;
+            std::atomic<const wchar_t*> fmtW;
+            std::atomic<int> level;
+            std::atomic<int> threshold;
+            std::atomic<const SinkTable*> sinks;
+            std::mutex sinkMutex;
+            std::atomic<int> timePrecision;
 
-            static Logger logger;
+            RingBuffer<AsyncRecord>* asyncQueue;
+            size_t asyncCapacity;
+            OverflowPolicy overflowPolicy;
+            std::thread asyncThread;
+            std::atomic<bool> asyncRunning;
+            std::atomic<bool> writerSleeping;
+            std::atomic<bool> writerBusy;
+            std::mutex writerMutex;
+            std::condition_variable writerWakeup;
 
-            #if defined(PLATFORM_WINDOWS)
+            std::atomic<Sink*> binarySink;
+            std::mutex binaryMutex;
+            std::atomic<uint32_t> definedFormats;
 
-            HANDLE handle;
+            // Written by producers and the writer thread; kept off the read-mostly
+            // configuration above so logging threads do not share its cache lines.
+            alignas(64) std::atomic<uint64_t> pushedRecords;
+            alignas(64) std::atomic<uint64_t> retiredRecords;
+            std::atomic<uint64_t> queueHighWater;
+            alignas(64) std::atomic<uint64_t> dropped;
 
-            static int FORMAT_COLOR_BLACK;
-            static int FORMAT_COLOR_RED;
-            static int FORMAT_COLOR_GREEN;
-            static int FORMAT_COLOR_YELLOW;
-            static int FORMAT_COLOR_BLUE;
-            static int FORMAT_COLOR_MAGENTA;
-            static int FORMAT_COLOR_CYAN;
-            static int FORMAT_COLOR_WHITE;
-            static int FORMAT_COLOR_RESET;
+            const char* name;
+            uint32_t nameHash;
+            Logger* parent;
+            Logger* root;
+            std::atomic<Logger*> sinkOwner;
+            bool ownsSinks;
+            int configuredThreshold;
 
-            #else
+            static Logger logger;
+            static std::atomic<int64_t> rateInterval;
+            static std::atomic<uint32_t> samplingPolicy[LEVEL_ASSERT + 1];
+
+            #if defined(PLATFORM_WINDOWS)
+            HANDLE handle;
+            #endif
 
             static const char* FORMAT_COLOR_BLACK;
             static const char* FORMAT_COLOR_RED;
@@ -155,8 +724,6 @@ namespace AK
             static const char* FORMAT_COLOR_CYAN;
             static const char* FORMAT_COLOR_WHITE;
             static const char* FORMAT_COLOR_RESET;
-
-            #endif
         };
     }
 }
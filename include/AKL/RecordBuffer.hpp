@@ -0,0 +1,200 @@
+#ifndef AK_RECORD_BUFFER_H
+#define AK_RECORD_BUFFER_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "Arena.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        template<typename CharT>
+        inline size_t stringLength(const CharT* str)
+        {
+            size_t length = 0;
+            while (str[length] != 0) length++;
+            return length;
+        }
+
+        inline int formatArgs(char* dest, size_t size, const char* text, va_list args)
+        {
+            return vsnprintf(dest, size, text, args);
+        }
+
+        inline int formatArgs(wchar_t* dest, size_t size, const wchar_t* text, va_list args)
+        {
+            return vswprintf(dest, size, text, args);
+        }
+
+        // Per-thread scratch space a record is assembled in before it is written with a single
+        // call. It starts on an inline block and only grows for oversized messages, taking
+        // blocks from the thread's RecordArena; the grown block is kept for the thread's
+        // following records.
+        template<typename CharT>
+        class RecordBuffer
+        {
+        public:
+            static const size_t INLINE_SIZE = 1024;
+            static const size_t MAX_SIZE = 16 * 1024 * 1024;
+
+            RecordBuffer()
+                : buffer(inlineBuffer), length(0), capacity(INLINE_SIZE), arena(&RecordArena::local())
+            {
+                buffer[0] = 0;
+            }
+
+            ~RecordBuffer()
+            {
+                if (buffer != inlineBuffer) arena->release(buffer, capacity * sizeof(CharT));
+            }
+
+            RecordBuffer(const RecordBuffer&) = delete;
+            RecordBuffer& operator=(const RecordBuffer&) = delete;
+
+            void clear()
+            {
+                length = 0;
+                buffer[0] = 0;
+            }
+
+            const CharT* data() const
+            {
+                return buffer;
+            }
+
+            CharT* data()
+            {
+                return buffer;
+            }
+
+            size_t size() const
+            {
+                return length;
+            }
+
+            void append(const CharT* str, size_t size)
+            {
+                if (!reserve(length + size + 1)) size = capacity - length - 1;
+
+                memcpy(buffer + length, str, size * sizeof(CharT));
+                length += size;
+                buffer[length] = 0;
+            }
+
+            void append(const CharT* str)
+            {
+                append(str, stringLength(str));
+            }
+
+            // Widens a plain ASCII string such as a color escape.
+            void appendAscii(const char* str)
+            {
+                appendAscii(str, strlen(str));
+            }
+
+            void appendAscii(const char* str, size_t size)
+            {
+                if (!reserve(length + size + 1)) size = capacity - length - 1;
+
+                for (size_t i = 0; i < size; i++) buffer[length + i] = (CharT)str[i];
+                length += size;
+                buffer[length] = 0;
+            }
+
+            void appendRepeat(CharT c, size_t count)
+            {
+                if (!reserve(length + count + 1)) count = capacity - length - 1;
+
+                for (size_t i = 0; i < count; i++) buffer[length + i] = c;
+                length += count;
+                buffer[length] = 0;
+            }
+
+            // Makes room for up to count characters at the end and returns where they go;
+            // commit() then adds the number actually written. Returns nullptr past MAX_SIZE.
+            CharT* prepare(size_t count)
+            {
+                if (!reserve(length + count + 1)) return nullptr;
+                return buffer + length;
+            }
+
+            void commit(size_t count)
+            {
+                length += count;
+                buffer[length] = 0;
+            }
+
+            void appendFormat(const CharT* text, va_list args)
+            {
+                for (;;)
+                {
+                    size_t available = capacity - length;
+
+                    va_list copy;
+                    va_copy(copy, args);
+                    errno = 0;
+                    int written = formatArgs(buffer + length, available, text, copy);
+                    va_end(copy);
+
+                    if (written >= 0 && (size_t)written < available)
+                    {
+                        length += written;
+                        return;
+                    }
+
+                    // An unconvertible character fails the whole call; growing would not help.
+                    if (written < 0 && errno == EILSEQ)
+                    {
+                        buffer[length] = 0;
+                        return;
+                    }
+
+                    // vswprintf only reports failure, so grow geometrically until it fits.
+                    size_t needed = written >= 0 ? length + written + 1 : capacity * 2;
+                    if (!reserve(needed))
+                    {
+                        length = capacity - 1;
+                        buffer[length] = 0;
+                        return;
+                    }
+                }
+            }
+
+        private:
+            bool reserve(size_t size)
+            {
+                if (size <= capacity) return true;
+                if (capacity >= MAX_SIZE) return false;
+
+                size_t grownSize = capacity * 2;
+                while (grownSize < size && grownSize < MAX_SIZE) grownSize *= 2;
+                if (grownSize > MAX_SIZE) grownSize = MAX_SIZE;
+
+                size_t granted;
+                CharT* grown = (CharT*)arena->acquire(grownSize * sizeof(CharT), granted);
+                if (grown == nullptr) return false;
+
+                memcpy(grown, buffer, (length + 1) * sizeof(CharT));
+                if (buffer != inlineBuffer) arena->release(buffer, capacity * sizeof(CharT));
+
+                buffer = grown;
+                capacity = granted / sizeof(CharT);
+                return capacity >= size;
+            }
+
+            CharT* buffer;
+            size_t length;
+            size_t capacity;
+            RecordArena* arena;
+            CharT inlineBuffer[INLINE_SIZE];
+        };
+    }
+}
+
+#endif // AK_RECORD_BUFFER_H
@@ -0,0 +1,140 @@
+#ifndef AK_RING_BUFFER_H
+#define AK_RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace AK
+{
+    namespace Log
+    {
+        // Bounded lock-free queue (Vyukov). Every cell carries a sequence number that tells
+        // producers and consumers whether it is free, being filled or ready to be read, so
+        // any number of threads may push and pop without a lock.
+        template<typename T>
+        class RingBuffer
+        {
+        public:
+            explicit RingBuffer(size_t _capacity)
+                : cells(nullptr), mask(0), enqueuePos(0), dequeuePos(0)
+            {
+                size_t capacity = 2;
+                while (capacity < _capacity) capacity <<= 1;
+
+                cells = new Cell[capacity];
+                mask = capacity - 1;
+
+                for (size_t i = 0; i < capacity; i++)
+                {
+                    cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            ~RingBuffer()
+            {
+                delete[] cells;
+            }
+
+            RingBuffer(const RingBuffer&) = delete;
+            RingBuffer& operator=(const RingBuffer&) = delete;
+
+            // Claims a free cell and hands it to fill(T&). Returns false when the queue is full.
+            template<typename F>
+            bool tryPush(F fill)
+            {
+                Cell* cell;
+                size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+                for (;;)
+                {
+                    cell = &cells[pos & mask];
+                    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+                    if (diff == 0)
+                    {
+                        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                fill(cell->data);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Claims the oldest ready cell and hands it to consume(T&). Returns false when empty.
+            template<typename F>
+            bool tryPop(F consume)
+            {
+                Cell* cell;
+                size_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+                for (;;)
+                {
+                    cell = &cells[pos & mask];
+                    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+                    if (diff == 0)
+                    {
+                        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = dequeuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                consume(cell->data);
+                cell->sequence.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool empty() const
+            {
+                return size() == 0;
+            }
+
+            // Approximate while other threads are pushing or popping.
+            size_t size() const
+            {
+                size_t head = dequeuePos.load(std::memory_order_acquire);
+                size_t tail = enqueuePos.load(std::memory_order_acquire);
+                return tail > head ? tail - head : 0;
+            }
+
+            size_t capacity() const
+            {
+                return mask + 1;
+            }
+
+        private:
+            struct Cell
+            {
+                std::atomic<size_t> sequence;
+                T data;
+            };
+
+            Cell* cells;
+            size_t mask;
+
+            alignas(64) std::atomic<size_t> enqueuePos;
+            alignas(64) std::atomic<size_t> dequeuePos;
+        };
+    }
+}
+
+#endif // AK_RING_BUFFER_H
@@ -0,0 +1,242 @@
+#ifndef AK_SINK_H
+#define AK_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace AK
+{
+    namespace Log
+    {
+        struct Record;
+
+        // Destination for fully rendered records. write() receives one or more complete lines
+        // and may be called from several threads at once.
+        class Sink
+        {
+        public:
+            virtual ~Sink() {}
+
+            virtual void write(const char* data, size_t size) = 0;
+            virtual void flush() {}
+
+            // Asked once per record that passes the sink's threshold, before the record is
+            // formatted for it; write() only gets the records accepted here, and a record no
+            // sink accepts is never formatted. Sinks that only count, sample or rate-limit do
+            // their work here and return false. Called on the logging thread, also in async
+            // mode, and again on the writer thread for a record queued while the sinks changed.
+            virtual bool accept(const Record&) { return true; }
+
+            // Whether records for this sink keep their color escapes when it is registered with
+            // COLOR_AUTO; only terminals want them.
+            virtual bool supportsColor() const { return false; }
+
+            // The crash path, called from a signal handler while other threads may be stopped
+            // anywhere: only write(2) and lock-free atomics, no locks and no allocation.
+            // emergencyFlush() writes out what the sink has buffered and emergencyWrite() one
+            // record directly; by default a sink has nothing to save.
+            virtual void emergencyWrite(const char*, size_t) {}
+            virtual void emergencyFlush() {}
+
+            // Set for good once the crash path starts. Sinks that buffer then pass records
+            // straight to emergencyWrite() and leave their buffers to emergencyFlush().
+            static std::atomic<bool> crashing;
+        };
+
+        // Limits for a sink that gathers records and writes them out with one vectored
+        // system call: a batch goes out once it holds maxBytes bytes or maxRecords records (0
+        // for no count limit), or at the latest maxDelayMs after its first record. maxDelayMs
+        // bounds how late output shows up, so keep it small for interactive output.
+        struct BatchOptions
+        {
+            size_t maxBytes;
+            uint32_t maxRecords;
+            uint32_t maxDelayMs;
+        };
+
+        // Writes each record to stdout as it comes unless given BatchOptions, in which case
+        // records are gathered and a thread of the sink's own writes them out by the deadline.
+        class ConsoleSink : public Sink
+        {
+        public:
+            ConsoleSink();
+            ConsoleSink(const BatchOptions& options);
+            ~ConsoleSink();
+
+            void write(const char* data, size_t size) override;
+            void flush() override;
+            bool supportsColor() const override { return true; }
+            void emergencyWrite(const char* data, size_t size) override;
+            void emergencyFlush() override;
+
+        private:
+            void flushBatch();
+            void drain();
+
+            BatchOptions options;
+            std::mutex mutex;
+            char* batch;
+            size_t batched;
+            uint32_t batchedRecords;
+
+            std::thread drainThread;
+            std::condition_variable drainWakeup;
+            bool running;
+        };
+
+        // Appends to a file through a large in-memory buffer. Rollover happens when the file
+        // reaches maxSize bytes or every interval seconds (0 disables either trigger); the
+        // renaming and reopening run on the sink's own thread so logging threads keep writing
+        // to the old file meanwhile. The same thread preallocates the file PREALLOCATE_SIZE at
+        // a time once less than PREALLOCATE_WATERMARK is left ahead of the write offset.
+        // Rotated files are named path.1 (newest) to path.N and only the newest keep of them
+        // are retained (0 keeps all).
+        class FileSink : public Sink
+        {
+        public:
+            FileSink(const char* path);
+            FileSink(const char* path, uint64_t maxSize, uint32_t interval, uint32_t keep);
+            ~FileSink();
+
+            void write(const char* data, size_t size) override;
+            void flush() override;
+            void emergencyWrite(const char* data, size_t size) override;
+            void emergencyFlush() override;
+            void rotate();
+            bool isOpen() const;
+
+            // The buffer goes out when full and every FLUSH_INTERVAL_MS by default. maxBytes is
+            // capped at BUFFER_SIZE; 0 for maxBytes or maxDelayMs keeps the default.
+            void setBatching(const BatchOptions& options);
+
+            static const size_t BUFFER_SIZE = 256 * 1024;
+            static const uint64_t PREALLOCATE_SIZE = 16 * 1024 * 1024;
+            static const uint64_t PREALLOCATE_WATERMARK = 4 * 1024 * 1024;
+            static const uint32_t FLUSH_INTERVAL_MS = 200;
+
+        private:
+            void flushBuffer();
+            void preallocate();
+            void maintain();
+            void shiftRotatedFiles();
+            int openFile();
+
+            char path[4096];
+            uint64_t maxSize;
+            uint32_t interval;
+            uint32_t keep;
+
+            std::mutex mutex;
+            std::mutex rotateMutex;
+            int fd;
+            char* buffer;
+            size_t buffered;
+            uint32_t bufferedRecords;
+            std::atomic<size_t> batchBytes;
+            std::atomic<uint32_t> batchRecords;
+            std::atomic<uint32_t> batchDelayMs;
+            uint64_t fileSize;
+            uint64_t allocated;
+
+            std::thread maintenanceThread;
+            std::mutex maintenanceMutex;
+            std::condition_variable maintenanceWakeup;
+            std::atomic<bool> running;
+            std::atomic<bool> rotateRequested;
+            std::atomic<bool> preallocateRequested;
+        };
+
+        #if !defined(_WIN32) && !defined(_WIN64)
+
+        // Writes records straight into a shared memory mapping of the file. Each write reserves
+        // its bytes with one fetch-add on the shared offset and copies the record in, so there
+        // is no syscall per record and a crash loses nothing that was already copied. The file
+        // grows by chunkSize at a time up to maxChunks chunks; records beyond that are dropped.
+        // After a crash the file may end in zero bytes; they are trimmed when it is reopened
+        // and a clean close truncates them.
+        class MappedFileSink : public Sink
+        {
+        public:
+            MappedFileSink(const char* path);
+            MappedFileSink(const char* path, uint64_t chunkSize, uint32_t maxChunks);
+            ~MappedFileSink();
+
+            void write(const char* data, size_t size) override;
+            void flush() override;
+            void emergencyWrite(const char* data, size_t size) override;
+            bool isOpen() const;
+            uint64_t droppedBytes() const;
+
+            static const uint64_t CHUNK_SIZE = 64 * 1024 * 1024;
+            static const uint32_t MAX_CHUNKS = 1024;
+
+        private:
+            char* chunk(uint64_t index);
+            void copy(uint64_t position, const char* data, size_t size);
+
+            int fd;
+            uint64_t chunkSize;
+            uint32_t maxChunks;
+            std::atomic<char*>* chunks;
+            std::mutex mapMutex;
+
+            alignas(64) std::atomic<uint64_t> offset;
+            alignas(64) std::atomic<uint64_t> dropped;
+        };
+
+        #endif
+
+        struct UringRing;
+
+        // Appends to a file through io_uring on Linux. Records are gathered into BUFFER_COUNT
+        // registered buffers and every full one is submitted as a write of its own range of the
+        // registered file, so several can be in flight while logging goes on into the next
+        // free buffer. Finished buffers are recycled the next time the sink needs one, and
+        // write() only waits for storage when every buffer is still in flight, which stalls()
+        // counts. flush() submits the partly filled buffer without waiting; a thread of the
+        // sink's own does so every FLUSH_INTERVAL_MS, and the destructor waits for everything.
+        // Writes go to explicit offsets, so the file must have no other writer. Where io_uring
+        // is missing or refused it falls back to a FileSink on the same path, and when the
+        // ring fails later on it goes on with pwrite.
+        class UringFileSink : public Sink
+        {
+        public:
+            UringFileSink(const char* path);
+            ~UringFileSink();
+
+            void write(const char* data, size_t size) override;
+            void flush() override;
+            void emergencyWrite(const char* data, size_t size) override;
+            void emergencyFlush() override;
+            bool isOpen() const;
+            bool usesUring() const;
+            uint64_t stalls() const;
+
+            // Bytes the ring failed to write, 0 when the FileSink fallback is in use.
+            uint64_t failedBytes() const;
+
+            static const size_t BUFFER_SIZE = 256 * 1024;
+            static const uint32_t BUFFER_COUNT = 8;
+            static const uint32_t FLUSH_INTERVAL_MS = 200;
+
+        private:
+            void maintain();
+
+            UringRing* ring;
+            FileSink* fallback;
+            std::mutex mutex;
+            std::atomic<uint64_t> stallCount;
+
+            std::thread maintenanceThread;
+            std::mutex maintenanceMutex;
+            std::condition_variable maintenanceWakeup;
+            bool running;
+        };
+    }
+}
+
+#endif // AK_SINK_H
@@ -0,0 +1,154 @@
+#ifndef AK_STATS_H
+#define AK_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include "Arena.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        class Sink;
+
+        // One counter per WarningLevel.
+        static const size_t STATS_LEVELS = 7;
+
+        struct SinkStats
+        {
+            Sink* sink;
+            uint64_t bytes;
+            uint64_t writes;
+        };
+
+        // A snapshot from Logger::stats(). Counters run from startup and are summed over every
+        // thread that ever logged, so two snapshots give the rates in between.
+        struct LoggerStats
+        {
+            uint64_t emitted[STATS_LEVELS];  // written to at least one sink; async ones once dequeued
+            uint64_t dropped[STATS_LEVELS];  // lost to a full async queue
+            uint64_t declined;               // passed the thresholds but no sink's accept() took them
+            uint64_t suppressed;             // held back by the rate limiter
+            uint64_t truncated;              // async records cut to their queue slot for lack of memory
+
+            // Formatting and sink time of every TIMING_INTERVAL-th record a thread writes.
+            uint64_t timedRecords;
+            uint64_t formatNanoseconds;
+            uint64_t writeNanoseconds;
+
+            // Async queue records waiting right now, the most there have been and the capacity;
+            // all 0 when the logger is synchronous.
+            size_t queueDepth;
+            size_t queueHighWater;
+            size_t queueCapacity;
+
+            // Bytes and write() calls per sink, MAX_STATS_SINKS at most; otherBytes and
+            // otherWrites count the sinks that did not fit.
+            static const size_t MAX_STATS_SINKS = 16;
+            SinkStats sinks[MAX_STATS_SINKS];
+            size_t sinkCount;
+            uint64_t otherBytes;
+            uint64_t otherWrites;
+
+            ArenaStats arena;
+        };
+
+        // The calling thread's counters. Each is only written by its owner, with a plain load
+        // and store rather than a locked increment, and read by whoever sums them. Blocks are
+        // never freed: a thread that exits hands its block, counts included, to the next new
+        // thread.
+        class ThreadCounters
+        {
+        public:
+            static const uint32_t TIMING_INTERVAL = 64;
+
+            static ThreadCounters& local();
+
+            void countEmitted(int level) { bump(emitted[level], 1); }
+            void countDropped(int level) { bump(dropped[level], 1); }
+            void countDeclined() { bump(declined, 1); }
+            void countSuppressed() { bump(suppressed, 1); }
+            void countTruncated() { bump(truncated, 1); }
+
+            void countWrite(Sink* sink, size_t size)
+            {
+                size_t start = (size_t)(((uintptr_t)sink >> 4) * 0x9E3779B9u) % LoggerStats::MAX_STATS_SINKS;
+
+                for (size_t probe = 0; probe < LoggerStats::MAX_STATS_SINKS; probe++)
+                {
+                    SinkSlot& slot = sinks[(start + probe) % LoggerStats::MAX_STATS_SINKS];
+                    Sink* key = slot.sink.load(std::memory_order_relaxed);
+
+                    if (key == nullptr) slot.sink.store(key = sink, std::memory_order_release);
+                    if (key != sink) continue;
+
+                    bump(slot.bytes, size);
+                    bump(slot.writes, 1);
+                    return;
+                }
+
+                bump(otherBytes, size);
+                bump(otherWrites, 1);
+            }
+
+            // Whether the record about to be written is one of the timed ones.
+            bool timeNext()
+            {
+                if (--timingCountdown != 0) return false;
+
+                timingCountdown = TIMING_INTERVAL;
+                return true;
+            }
+
+            void addTiming(int64_t formatNanoseconds, int64_t writeNanoseconds)
+            {
+                bump(timedRecords, 1);
+                bump(formatTime, (uint64_t)formatNanoseconds);
+                bump(writeTime, (uint64_t)writeNanoseconds);
+            }
+
+            static int64_t now()
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // Adds every block's counters to stats, whose counters must start out zeroed.
+            static void sum(LoggerStats& stats);
+
+        private:
+            struct SinkSlot
+            {
+                std::atomic<Sink*> sink;
+                std::atomic<uint64_t> bytes;
+                std::atomic<uint64_t> writes;
+            };
+
+            static void bump(std::atomic<uint64_t>& counter, uint64_t amount)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+
+            friend class ThreadCountersOwner;
+
+            std::atomic<uint64_t> emitted[STATS_LEVELS];
+            std::atomic<uint64_t> dropped[STATS_LEVELS];
+            std::atomic<uint64_t> declined;
+            std::atomic<uint64_t> suppressed;
+            std::atomic<uint64_t> truncated;
+            std::atomic<uint64_t> timedRecords;
+            std::atomic<uint64_t> formatTime;
+            std::atomic<uint64_t> writeTime;
+            SinkSlot sinks[LoggerStats::MAX_STATS_SINKS];
+            std::atomic<uint64_t> otherBytes;
+            std::atomic<uint64_t> otherWrites;
+            uint32_t timingCountdown;
+
+            ThreadCounters* next;
+            std::atomic<bool> claimed;
+        };
+    }
+}
+
+#endif // AK_STATS_H
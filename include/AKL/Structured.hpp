@@ -0,0 +1,62 @@
+#ifndef AK_STRUCTURED_H
+#define AK_STRUCTURED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <string_view>
+#include "Format.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        // Whether a logKV argument list is made of string keys each followed by a value.
+        template<typename... Args>
+        struct KeyValueArgs
+        {
+            static constexpr bool valid = false;
+        };
+
+        template<>
+        struct KeyValueArgs<>
+        {
+            static constexpr bool valid = true;
+        };
+
+        template<typename Key, typename Value, typename... Rest>
+        struct KeyValueArgs<Key, Value, Rest...>
+        {
+            static constexpr bool valid = (std::is_convertible<const Key&, const char*>::value || std::is_convertible<const Key&, std::string_view>::value) &&
+                                          KeyValueArgs<Rest...>::valid;
+        };
+
+        // A record's fields are packed into one buffer, each as its key, a NUL, a kind byte
+        // (FIELD_STRING values are quoted in JSON, FIELD_BARE ones are numbers, booleans or
+        // null), the value formatted as for "{}" and another NUL. Values are formatted once
+        // and only escaped per output.
+        static const char FIELD_STRING = 's';
+        static const char FIELD_BARE = 'b';
+
+        void packField(RecordBuffer<char>& out, const FormatArg& key, const FormatArg& value);
+
+        // The size of the longest run of whole fields from the start of packed that fits in
+        // limit bytes.
+        size_t packedPrefix(const char* packed, size_t size, size_t limit);
+
+        // Appends text as the contents of a JSON string, escaping quotes, backslashes and
+        // control characters; the scan for them runs 16 bytes at a time with SSE2.
+        void appendJsonString(RecordBuffer<char>& out, const char* text, size_t length);
+
+        // Appends text as a logfmt value, quoted and escaped only if it is empty or contains
+        // spaces, '=', quotes or control characters.
+        void appendLogfmtValue(RecordBuffer<char>& out, const char* text, size_t length);
+
+        // Appends the packed fields as ,"key":value members of a JSON object, or as
+        // " key=value" pairs.
+        void appendJsonFields(RecordBuffer<char>& out, const char* packed, size_t size);
+        void appendLogfmtFields(RecordBuffer<char>& out, const char* packed, size_t size);
+    }
+}
+
+#endif // AK_STRUCTURED_H
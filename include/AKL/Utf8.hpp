@@ -0,0 +1,70 @@
+#ifndef AK_UTF8_H
+#define AK_UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+#include "RecordBuffer.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        // Worst-case UTF-8 bytes per wchar_t unit: a UTF-16 surrogate pair takes 4 bytes for
+        // 2 units, any other unit at most 3; a UTF-32 unit at most 4.
+        static const size_t UTF8_MAX_PER_WCHAR = sizeof(wchar_t) == 2 ? 3 : 4;
+
+        // Surrogates and values past U+10FFFF are written as U+FFFD.
+        inline size_t encodeUtf8(uint32_t codePoint, char* out)
+        {
+            if (codePoint < 0x80)
+            {
+                out[0] = (char)codePoint;
+                return 1;
+            }
+            if (codePoint < 0x800)
+            {
+                out[0] = (char)(0xC0 | (codePoint >> 6));
+                out[1] = (char)(0x80 | (codePoint & 0x3F));
+                return 2;
+            }
+            if (codePoint >= 0xD800 && codePoint < 0xE000) codePoint = 0xFFFD;
+            if (codePoint < 0x10000)
+            {
+                out[0] = (char)(0xE0 | (codePoint >> 12));
+                out[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                out[2] = (char)(0x80 | (codePoint & 0x3F));
+                return 3;
+            }
+            if (codePoint < 0x110000)
+            {
+                out[0] = (char)(0xF0 | (codePoint >> 18));
+                out[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                out[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                out[3] = (char)(0x80 | (codePoint & 0x3F));
+                return 4;
+            }
+
+            out[0] = (char)0xEF;
+            out[1] = (char)0xBF;
+            out[2] = (char)0xBD;
+            return 3;
+        }
+
+        // Converts length wide units (UTF-16 or UTF-32, per the platform's wchar_t) to UTF-8
+        // and returns the bytes written; dest needs UTF8_MAX_PER_WCHAR bytes per unit. Runs of
+        // ASCII are converted with SSE2, or AVX2 where the CPU has it. Unpaired surrogates and
+        // out-of-range values become U+FFFD.
+        size_t wideToUtf8(const wchar_t* src, size_t length, char* dest);
+
+        // The reverse: converts length UTF-8 bytes and returns the wide units written; dest
+        // needs one unit per byte. Malformed sequences, overlong forms and encoded surrogates
+        // become U+FFFD.
+        size_t utf8ToWide(const char* src, size_t length, wchar_t* dest);
+
+        void appendUtf8(RecordBuffer<char>& out, const wchar_t* text, size_t length);
+        void appendWide(RecordBuffer<wchar_t>& out, const char* text, size_t length);
+    }
+}
+
+#endif // AK_UTF8_H
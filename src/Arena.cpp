@@ -0,0 +1,188 @@
+#include "AKL/Arena.hpp"
+#include <stdlib.h>
+#include <atomic>
+
+namespace AK
+{
+    namespace Log
+    {
+        static std::atomic<size_t> totalReserved(0);
+        static std::atomic<size_t> totalInUse(0);
+        static std::atomic<size_t> totalHighWater(0);
+        static std::atomic<size_t> totalHeapAllocations(0);
+
+        RecordArena& RecordArena::local()
+        {
+            static thread_local RecordArena arena;
+            return arena;
+        }
+
+        RecordArena::RecordArena()
+            : slabs(nullptr), slabCursor(nullptr), slabRemaining(0),
+              reservedBytes(0), inUseBytes(0), highWaterBytes(0), heapAllocations(0)
+        {
+            for (size_t i = 0; i < CLASS_COUNT; i++)
+            {
+                freeLists[i] = nullptr;
+                cached[i] = 0;
+            }
+        }
+
+        RecordArena::~RecordArena()
+        {
+            for (size_t i = 0; i < CLASS_COUNT; i++)
+            {
+                if (classSize(i) <= SLAB_SIZE) continue;
+
+                while (freeLists[i] != nullptr)
+                {
+                    FreeBlock* block = freeLists[i];
+                    freeLists[i] = block->next;
+                    free(block);
+                }
+            }
+
+            while (slabs != nullptr)
+            {
+                Slab* slab = slabs;
+                slabs = slab->next;
+                free(slab);
+            }
+
+            totalReserved.fetch_sub(reservedBytes, std::memory_order_relaxed);
+            totalInUse.fetch_sub(inUseBytes, std::memory_order_relaxed);
+        }
+
+        size_t RecordArena::sizeClass(size_t size)
+        {
+            size_t index = 0;
+            while (classSize(index) < size) index++;
+            return index;
+        }
+
+        size_t RecordArena::classSize(size_t index)
+        {
+            return MIN_BLOCK << index;
+        }
+
+        void* RecordArena::acquire(size_t size, size_t& granted)
+        {
+            if (size > MAX_BLOCK) return nullptr;
+
+            size_t index = sizeClass(size);
+            size_t blockSize = classSize(index);
+            void* block = freeLists[index];
+
+            if (block != nullptr)
+            {
+                freeLists[index] = freeLists[index]->next;
+                cached[index]--;
+            }
+            else
+            {
+                block = blockSize <= SLAB_SIZE ? carve(blockSize) : allocate(blockSize);
+                if (block == nullptr) return nullptr;
+            }
+
+            granted = blockSize;
+            track((intptr_t)blockSize);
+            return block;
+        }
+
+        void RecordArena::release(void* block, size_t granted)
+        {
+            size_t index = sizeClass(granted);
+            track(-(intptr_t)granted);
+
+            if (granted > SLAB_SIZE && cached[index] >= MAX_CACHED_LARGE)
+            {
+                free(block);
+                reservedBytes -= granted;
+                totalReserved.fetch_sub(granted, std::memory_order_relaxed);
+                return;
+            }
+
+            FreeBlock* freed = (FreeBlock*)block;
+            freed->next = freeLists[index];
+            freeLists[index] = freed;
+            cached[index]++;
+        }
+
+        // Cuts a small block from the current slab. The tail of an exhausted slab is split into
+        // the largest blocks that fit and cached rather than wasted.
+        void* RecordArena::carve(size_t size)
+        {
+            if (slabRemaining < size)
+            {
+                while (slabRemaining >= MIN_BLOCK)
+                {
+                    size_t index = CLASS_COUNT - 1;
+                    while (classSize(index) > slabRemaining) index--;
+
+                    FreeBlock* block = (FreeBlock*)slabCursor;
+                    block->next = freeLists[index];
+                    freeLists[index] = block;
+                    cached[index]++;
+
+                    slabCursor += classSize(index);
+                    slabRemaining -= classSize(index);
+                }
+
+                Slab* slab = (Slab*)allocate(sizeof(Slab) + SLAB_SIZE);
+                if (slab == nullptr) return nullptr;
+
+                slab->next = slabs;
+                slabs = slab;
+                slabCursor = (char*)(slab + 1);
+                slabRemaining = SLAB_SIZE;
+            }
+
+            void* block = slabCursor;
+            slabCursor += size;
+            slabRemaining -= size;
+            return block;
+        }
+
+        void* RecordArena::allocate(size_t size)
+        {
+            void* block = malloc(size);
+            if (block == nullptr) return nullptr;
+
+            reservedBytes += size;
+            heapAllocations++;
+            totalReserved.fetch_add(size, std::memory_order_relaxed);
+            totalHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+
+        void RecordArena::track(intptr_t inUse)
+        {
+            inUseBytes += inUse;
+            if (inUseBytes > highWaterBytes) highWaterBytes = inUseBytes;
+
+            size_t total = totalInUse.fetch_add((size_t)inUse, std::memory_order_relaxed) + (size_t)inUse;
+            size_t highWater = totalHighWater.load(std::memory_order_relaxed);
+            while (total > highWater && !totalHighWater.compare_exchange_weak(highWater, total, std::memory_order_relaxed));
+        }
+
+        ArenaStats RecordArena::stats() const
+        {
+            ArenaStats stats;
+            stats.reservedBytes = reservedBytes;
+            stats.inUseBytes = inUseBytes;
+            stats.highWaterBytes = highWaterBytes;
+            stats.heapAllocations = heapAllocations;
+            return stats;
+        }
+
+        ArenaStats getArenaStats()
+        {
+            ArenaStats stats;
+            stats.reservedBytes = totalReserved.load(std::memory_order_relaxed);
+            stats.inUseBytes = totalInUse.load(std::memory_order_relaxed);
+            stats.highWaterBytes = totalHighWater.load(std::memory_order_relaxed);
+            stats.heapAllocations = totalHeapAllocations.load(std::memory_order_relaxed);
+            return stats;
+        }
+    }
+}
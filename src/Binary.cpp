@@ -0,0 +1,264 @@
+#include "AKL/log.hpp"
+#include "AKL/Binary.hpp"
+#include "AKL/RecordBuffer.hpp"
+#include <stdarg.h>
+#include <string.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        struct BinaryFormat
+        {
+            const void* text;
+            bool wide;
+            uint8_t argCount;
+            uint8_t argTypes[BINARY_MAX_ARGS];
+        };
+
+        static BinaryFormat binaryFormats[BINARY_MAX_FORMATS];
+        static std::atomic<uint32_t> binaryFormatCount(0);
+        static std::mutex binaryRegistryMutex;
+
+        static thread_local RecordBuffer<char> binaryBuffer;
+
+        template<typename T>
+        static void appendValue(RecordBuffer<char>& buffer, const T& value)
+        {
+            buffer.append((const char*)&value, sizeof(T));
+        }
+
+        template<typename CharT>
+        static uint32_t addFormat(const CharT* text, bool wide)
+        {
+            std::lock_guard<std::mutex> lock(binaryRegistryMutex);
+
+            uint32_t id = binaryFormatCount.load(std::memory_order_relaxed);
+            if (id >= BINARY_MAX_FORMATS) return BINARY_INVALID_ID;
+
+            BinaryFormat& format = binaryFormats[id];
+            format.text = text;
+            format.wide = wide;
+            format.argCount = 0;
+
+            for (size_t i = 0; text[i] != 0; i++)
+            {
+                if (text[i] != '%') continue;
+
+                if (text[i + 1] == '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                ConversionSpec spec;
+                if (!parseConversion(text + i, spec)) break;
+
+                BinaryArgType types[3];
+                size_t count = 0;
+
+                if (spec.widthStar) types[count++] = ARG_INT32;
+                if (spec.precisionStar) types[count++] = ARG_INT32;
+
+                BinaryArgType type = conversionArgType(spec, wide);
+                if (type != ARG_NONE) types[count++] = type;
+
+                if (format.argCount + count > BINARY_MAX_ARGS) return BINARY_INVALID_ID;
+
+                for (size_t j = 0; j < count; j++) format.argTypes[format.argCount++] = (uint8_t)types[j];
+
+                i += spec.length - 1;
+            }
+
+            binaryFormatCount.store(id + 1, std::memory_order_release);
+            return id;
+        }
+
+        // Format strings are referenced, not copied, so they must have static storage duration
+        // like the literals the LOG_*_BINARY macros pass in.
+        uint32_t Logger::registerFormat(const char* text)
+        {
+            return addFormat(text, false);
+        }
+
+        uint32_t Logger::registerFormat(const wchar_t* text)
+        {
+            return addFormat(text, true);
+        }
+
+        // The stream starts with a header; every format registered so far is written again
+        // lazily in front of the first record that needs it.
+        void Logger::setBinarySink(Sink* _sink)
+        {
+            std::lock_guard<std::mutex> lock(binaryMutex);
+
+            if (_sink != nullptr)
+            {
+                char header[5];
+                memcpy(header, BINARY_MAGIC, 4);
+                header[4] = (char)BINARY_VERSION;
+                _sink->write(header, sizeof(header));
+            }
+
+            definedFormats.store(0, std::memory_order_release);
+            binarySink.store(_sink, std::memory_order_release);
+        }
+
+        void Logger::logBinary(WarningLevel _level, uint32_t id, const char* text, ...)
+        {
+            if (!isEnabled(_level)) return;
+
+            va_list args;
+            va_start(args, text);
+
+            Sink* target = binarySink.load(std::memory_order_acquire);
+            if (target == nullptr || id == BINARY_INVALID_ID) log(_level, text, args);
+            else writeBinary(target, _level, id, args);
+
+            va_end(args);
+        }
+
+        void Logger::logBinaryW(WarningLevel _level, uint32_t id, const wchar_t* text, ...)
+        {
+            if (!isEnabled(_level)) return;
+
+            va_list args;
+            va_start(args, text);
+
+            Sink* target = binarySink.load(std::memory_order_acquire);
+            if (target == nullptr || id == BINARY_INVALID_ID) logW(_level, text, args);
+            else writeBinary(target, _level, id, args);
+
+            va_end(args);
+        }
+
+        void Logger::defineFormats(Sink* target, uint32_t id)
+        {
+            std::lock_guard<std::mutex> lock(binaryMutex);
+
+            uint32_t defined = definedFormats.load(std::memory_order_relaxed);
+            uint32_t available = binaryFormatCount.load(std::memory_order_acquire);
+            if (id < defined) return;
+
+            RecordBuffer<char> buffer;
+
+            for (uint32_t i = defined; i < available; i++)
+            {
+                const BinaryFormat& format = binaryFormats[i];
+                uint32_t lengthOffset;
+
+                appendValue(buffer, BINARY_ENTRY_FORMAT);
+                appendValue(buffer, i);
+                appendValue(buffer, (uint8_t)format.wide);
+                appendValue(buffer, format.argCount);
+                buffer.append((const char*)format.argTypes, format.argCount);
+
+                lengthOffset = (uint32_t)buffer.size();
+                appendValue(buffer, (uint32_t)0);
+
+                if (format.wide)
+                {
+                    const wchar_t* text = (const wchar_t*)format.text;
+                    appendUtf8(buffer, text, stringLength(text));
+                }
+                else
+                {
+                    const char* text = (const char*)format.text;
+                    buffer.append(text, stringLength(text));
+                }
+
+                uint32_t length = (uint32_t)(buffer.size() - lengthOffset - sizeof(uint32_t));
+                memcpy(buffer.data() + lengthOffset, &length, sizeof(length));
+            }
+
+            if (buffer.size() > 0) target->write(buffer.data(), buffer.size());
+            definedFormats.store(available, std::memory_order_release);
+        }
+
+        // Copies the raw arguments into the record instead of formatting them; strings are the
+        // only arguments that cost more than a fixed-size store.
+        void Logger::writeBinary(Sink* target, WarningLevel _level, uint32_t id, va_list args)
+        {
+            if (id >= definedFormats.load(std::memory_order_acquire)) defineFormats(target, id);
+
+            const BinaryFormat& format = binaryFormats[id];
+            RecordBuffer<char>& buffer = binaryBuffer;
+            buffer.clear();
+
+            appendValue(buffer, BINARY_ENTRY_RECORD);
+            appendValue(buffer, (uint8_t)_level);
+            appendValue(buffer, id);
+            appendValue(buffer, currentTimestamp());
+
+            size_t payloadOffset = buffer.size();
+            appendValue(buffer, (uint32_t)0);
+
+            for (uint8_t i = 0; i < format.argCount; i++)
+            {
+                switch ((BinaryArgType)format.argTypes[i])
+                {
+                    case ARG_INT32:
+                        appendValue(buffer, (int32_t)va_arg(args, int));
+                        break;
+                    case ARG_INT64:
+                        appendValue(buffer, (int64_t)va_arg(args, long long));
+                        break;
+                    case ARG_DOUBLE:
+                        appendValue(buffer, va_arg(args, double));
+                        break;
+                    case ARG_LONG_DOUBLE:
+                        appendValue(buffer, (double)va_arg(args, long double));
+                        break;
+                    case ARG_POINTER:
+                        appendValue(buffer, (uint64_t)(uintptr_t)va_arg(args, void*));
+                        break;
+                    case ARG_CHAR:
+                    case ARG_WCHAR:
+                        appendValue(buffer, (uint32_t)va_arg(args, unsigned int));
+                        break;
+                    case ARG_STRING:
+                    {
+                        const char* text = va_arg(args, const char*);
+                        if (text == nullptr)
+                        {
+                            appendValue(buffer, BINARY_NULL_STRING);
+                            break;
+                        }
+
+                        uint32_t length = (uint32_t)stringLength(text);
+                        appendValue(buffer, length);
+                        buffer.append(text, length);
+                        break;
+                    }
+                    case ARG_WSTRING:
+                    {
+                        const wchar_t* text = va_arg(args, const wchar_t*);
+                        if (text == nullptr)
+                        {
+                            appendValue(buffer, BINARY_NULL_STRING);
+                            break;
+                        }
+
+                        size_t lengthOffset = buffer.size();
+                        appendValue(buffer, (uint32_t)0);
+                        appendUtf8(buffer, text, stringLength(text));
+
+                        uint32_t length = (uint32_t)(buffer.size() - lengthOffset - sizeof(uint32_t));
+                        memcpy(buffer.data() + lengthOffset, &length, sizeof(length));
+                        break;
+                    }
+                    case ARG_IGNORED:
+                        va_arg(args, void*);
+                        break;
+                    case ARG_NONE:
+                        break;
+                }
+            }
+
+            uint32_t payloadSize = (uint32_t)(buffer.size() - payloadOffset - sizeof(uint32_t));
+            memcpy(buffer.data() + payloadOffset, &payloadSize, sizeof(payloadSize));
+
+            target->write(buffer.data(), buffer.size());
+        }
+    }
+}
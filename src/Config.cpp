@@ -0,0 +1,230 @@
+#include "AKL/log.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        // Layout strings read from a file. Loggers reference layouts without owning them, so
+        // these are never freed; identical strings are shared, so reloading the same file
+        // does not grow the list.
+        template<typename CharT>
+        struct InternedText
+        {
+            InternedText* next;
+            CharT text[1];
+        };
+
+        static std::mutex internMutex;
+        static InternedText<char>* internedNarrow = nullptr;
+        static InternedText<wchar_t>* internedWide = nullptr;
+
+        template<typename CharT>
+        static const CharT* intern(InternedText<CharT>*& list, const CharT* text, size_t length)
+        {
+            std::lock_guard<std::mutex> lock(internMutex);
+
+            for (InternedText<CharT>* entry = list; entry != nullptr; entry = entry->next)
+            {
+                if (stringLength(entry->text) == length && memcmp(entry->text, text, length * sizeof(CharT)) == 0) return entry->text;
+            }
+
+            InternedText<CharT>* entry = (InternedText<CharT>*)malloc(sizeof(InternedText<CharT>) + length * sizeof(CharT));
+            if (entry == nullptr) return nullptr;
+
+            memcpy(entry->text, text, length * sizeof(CharT));
+            entry->text[length] = 0;
+            entry->next = list;
+            list = entry;
+            return entry->text;
+        }
+
+        static char* trim(char* text)
+        {
+            while (isspace((unsigned char)*text)) text++;
+
+            size_t length = strlen(text);
+            while (length > 0 && isspace((unsigned char)text[length - 1])) text[--length] = '\0';
+            return text;
+        }
+
+        static bool parseLevel(const char* text, WarningLevel& result)
+        {
+            static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "ASSERT" };
+
+            for (int i = 0; i <= LEVEL_ASSERT; i++)
+            {
+                size_t j = 0;
+                while (names[i][j] != '\0' && toupper((unsigned char)text[j]) == names[i][j]) j++;
+
+                if (names[i][j] == '\0' && text[j] == '\0')
+                {
+                    result = (WarningLevel)i;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // Resolves \n, \t and \\ in place.
+        static size_t unescape(char* text)
+        {
+            size_t out = 0;
+
+            for (size_t i = 0; text[i] != '\0'; i++)
+            {
+                if (text[i] == '\\' && text[i + 1] != '\0')
+                {
+                    i++;
+                    text[out++] = text[i] == 'n' ? '\n' : text[i] == 't' ? '\t' : text[i];
+                }
+                else text[out++] = text[i];
+            }
+
+            text[out] = '\0';
+            return out;
+        }
+
+        static void applySetting(char* key, char* value)
+        {
+            Logger* root = Logger::get();
+            size_t keyLength = strlen(key);
+            WarningLevel level;
+
+            if (strcmp(key, "layout") == 0)
+            {
+                size_t length = unescape(value);
+                wchar_t* wide = new wchar_t[length + 1];
+                size_t wideLength = utf8ToWide(value, length, wide);
+
+                const char* layout = intern(internedNarrow, value, length);
+                const wchar_t* layoutW = intern(internedWide, wide, wideLength);
+                delete[] wide;
+
+                if (layout != nullptr && layoutW != nullptr) root->setLayout(layout, layoutW);
+            }
+            else if (strcmp(key, "time_precision") == 0)
+            {
+                if (strcmp(value, "s") == 0) root->setTimePrecision(PRECISION_SECONDS);
+                else if (strcmp(value, "ms") == 0) root->setTimePrecision(PRECISION_MILLISECONDS);
+                else if (strcmp(value, "us") == 0) root->setTimePrecision(PRECISION_MICROSECONDS);
+            }
+            else if (strcmp(key, "level") == 0)
+            {
+                if (parseLevel(value, level)) root->setThreshold(level);
+            }
+            else if (keyLength > 6 && strcmp(key + keyLength - 6, ".level") == 0)
+            {
+                key[keyLength - 6] = '\0';
+                Logger* named = Logger::get(key);
+
+                if (strcmp(value, "inherit") == 0) named->inheritThreshold();
+                else if (parseLevel(value, level)) named->setThreshold(level);
+            }
+        }
+
+        bool Logger::loadConfig(const char* path)
+        {
+            FILE* file = fopen(path, "r");
+            if (file == nullptr) return false;
+
+            char line[1024];
+            while (fgets(line, sizeof(line), file) != nullptr)
+            {
+                char* comment = strchr(line, '#');
+                if (comment != nullptr) *comment = '\0';
+
+                char* separator = strchr(line, '=');
+                if (separator == nullptr) continue;
+
+                *separator = '\0';
+                char* key = trim(line);
+                char* value = trim(separator + 1);
+                if (key[0] != '\0' && value[0] != '\0') applySetting(key, value);
+            }
+
+            fclose(file);
+            return true;
+        }
+
+        // The reloader thread: it reloads on request and retries freeing retired snapshots
+        // that still had readers when they were replaced. Held by pointer so a watcher still
+        // running at exit does not terminate the process.
+        static std::thread* reloaderThread = nullptr;
+        static std::mutex reloaderMutex;
+        static std::condition_variable reloaderWakeup;
+        static std::atomic<bool> reloaderRunning(false);
+        static std::atomic<bool> reloadRequested(false);
+        static char configPath[4096];
+
+        static const uint32_t RELOADER_INTERVAL_MS = 100;
+
+        static void reloader()
+        {
+            while (reloaderRunning.load())
+            {
+                {
+                    std::unique_lock<std::mutex> lock(reloaderMutex);
+                    reloaderWakeup.wait_for(lock, std::chrono::milliseconds((int64_t)RELOADER_INTERVAL_MS));
+                }
+
+                if (reloadRequested.exchange(false)) Logger::loadConfig(configPath);
+                reclaim();
+            }
+        }
+
+        #if !defined(PLATFORM_WINDOWS)
+
+        // Only touches a lock-free atomic, which is async-signal-safe; the reloader thread
+        // notices the flag within RELOADER_INTERVAL_MS.
+        static void onHangup(int)
+        {
+            reloadRequested.store(true);
+        }
+
+        #endif
+
+        void Logger::watchConfig(const char* path)
+        {
+            stopWatching();
+
+            strncpy(configPath, path, sizeof(configPath) - 1);
+            configPath[sizeof(configPath) - 1] = '\0';
+
+            #if !defined(PLATFORM_WINDOWS)
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = onHangup;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_RESTART;
+            sigaction(SIGHUP, &action, nullptr);
+            #endif
+
+            reloaderRunning.store(true);
+            reloaderThread = new std::thread(reloader);
+        }
+
+        void Logger::stopWatching()
+        {
+            if (!reloaderRunning.exchange(false)) return;
+
+            {
+                std::lock_guard<std::mutex> lock(reloaderMutex);
+                reloaderWakeup.notify_one();
+            }
+
+            reloaderThread->join();
+            delete reloaderThread;
+            reloaderThread = nullptr;
+        }
+
+        void Logger::requestReload()
+        {
+            reloadRequested.store(true);
+        }
+    }
+}
@@ -0,0 +1,269 @@
+#include "AKL/log.hpp"
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        // A queued record rendered for the crash path into fixed storage; whatever does not
+        // fit is cut off.
+        struct EmergencyLine
+        {
+            char data[4096];
+            size_t length;
+
+            void append(const char* text, size_t size)
+            {
+                if (size > sizeof(data) - 1 - length) size = sizeof(data) - 1 - length;
+                memcpy(data + length, text, size);
+                length += size;
+            }
+
+            void append(const char* text)
+            {
+                append(text, strlen(text));
+            }
+
+            void appendDecimal(int64_t value)
+            {
+                char digits[24];
+                size_t count = 0;
+                uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+                do
+                {
+                    digits[sizeof(digits) - 1 - count++] = (char)('0' + magnitude % 10);
+                    magnitude /= 10;
+                }
+                while (magnitude != 0);
+
+                if (value < 0) digits[sizeof(digits) - 1 - count++] = '-';
+                append(digits + sizeof(digits) - count, count);
+            }
+
+            // Quotes, backslashes and control characters escaped as in JSON.
+            void appendEscaped(const char* text, size_t size)
+            {
+                static const char hex[] = "0123456789abcdef";
+
+                for (size_t i = 0; i < size; i++)
+                {
+                    unsigned char c = (unsigned char)text[i];
+
+                    if (c == '"' || c == '\\')
+                    {
+                        char escape[2] = { '\\', (char)c };
+                        append(escape, 2);
+                    }
+                    else if (c < 0x20)
+                    {
+                        char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                        append(escape, 6);
+                    }
+                    else append(text + i, 1);
+                }
+            }
+        };
+
+        static const char* LEVEL_NAMES[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "ASSERT" };
+
+        // A plain "[LEVEL time] message key=value" line for text sinks, since layouts need the
+        // regular formatting machinery, and bare-bones JSON or logfmt for structured sinks. The
+        // time is printed as microseconds since the epoch; calendar conversion is not
+        // async-signal-safe.
+        static void renderEmergency(EmergencyLine& line, OutputFormat output, WarningLevel level, int64_t timestamp, const char* text, const char* fields, size_t fieldsSize)
+        {
+            line.length = 0;
+
+            if (output == OUTPUT_JSON)
+            {
+                line.append("{\"time_us\":");
+                line.appendDecimal(timestamp);
+                line.append(",\"level\":\"");
+                line.append(LEVEL_NAMES[level]);
+                line.append("\",\"msg\":\"");
+                line.appendEscaped(text, strlen(text));
+                line.append("\"");
+            }
+            else if (output == OUTPUT_LOGFMT)
+            {
+                line.append("time_us=");
+                line.appendDecimal(timestamp);
+                line.append(" level=");
+                line.append(LEVEL_NAMES[level]);
+                line.append(" msg=\"");
+                line.appendEscaped(text, strlen(text));
+                line.append("\"");
+            }
+            else
+            {
+                line.append("[");
+                line.append(LEVEL_NAMES[level]);
+                line.append(" ");
+                line.appendDecimal(timestamp);
+                line.append("] ");
+                line.append(text);
+            }
+
+            size_t offset = 0;
+            while (offset < fieldsSize)
+            {
+                const char* key = fields + offset;
+                size_t keyLength = strnlen(key, fieldsSize - offset);
+                if (offset + keyLength + 2 > fieldsSize) break;
+
+                char kind = key[keyLength + 1];
+                const char* value = key + keyLength + 2;
+                size_t valueLength = strnlen(value, fieldsSize - offset - keyLength - 2);
+                bool quoted = kind == FIELD_STRING && output != OUTPUT_TEXT;
+
+                line.append(output == OUTPUT_JSON ? ",\"" : " ");
+                if (output == OUTPUT_JSON) line.appendEscaped(key, keyLength);
+                else line.append(key, keyLength);
+                line.append(output == OUTPUT_JSON ? "\":" : "=");
+
+                if (quoted) line.append("\"");
+                if (quoted) line.appendEscaped(value, valueLength);
+                else line.append(value, valueLength);
+                if (quoted) line.append("\"");
+
+                offset += keyLength + 2 + valueLength + 1;
+            }
+
+            if (output == OUTPUT_JSON) line.append("}");
+            line.append("\n");
+        }
+
+        void Logger::emergencyRecord(const AsyncRecord& record)
+        {
+            const SinkTable* table = record.origin->sinkOwner.load(std::memory_order_acquire)->sinks.load(std::memory_order_acquire);
+            bool selected = record.selection.generation == table->generation;
+            EmergencyLine line;
+
+            // Sinks are not asked again here, accept() need not be async-signal-safe.
+            for (size_t i = 0; i < table->count; i++)
+            {
+                const SinkEntry& entry = table->entries[i];
+                if (selected ? (record.selection.entries & (1u << i)) == 0 : record.level < entry.threshold) continue;
+
+                renderEmergency(line, table->layouts[entry.layout].output, record.level, record.timestamp, record.data(), record.data() + record.fieldsOffset, record.fieldsSize);
+                entry.sink->emergencyWrite(line.data, line.length);
+            }
+        }
+
+        std::atomic<bool> Sink::crashing(false);
+
+        // How long the crash path waits for the writer thread to finish its record; the
+        // writer may be the thread that crashed.
+        static const int WRITER_WAIT_MS = 100;
+
+        static void pauseMillisecond()
+        {
+            #if defined(PLATFORM_WINDOWS)
+            Sleep(1);
+            #else
+            struct timespec pause = { 0, 1000000 };
+            nanosleep(&pause, nullptr);
+            #endif
+        }
+
+        // Reads the sink tables without an EpochGuard: a crashing process frees nothing more.
+        // Sinks pass records from other threads straight through from here on, so the buffers
+        // flushed last no longer change underneath; they may end up after queued records that
+        // were logged later.
+        void Logger::emergencyFlush()
+        {
+            Sink::crashing.store(true, std::memory_order_seq_cst);
+
+            for (int waited = 0; waited < WRITER_WAIT_MS && logger.writerBusy.load(std::memory_order_seq_cst); waited++) pauseMillisecond();
+
+            RingBuffer<AsyncRecord>* queue = logger.asyncQueue;
+            if (queue != nullptr)
+            {
+                while (queue->tryPop([](AsyncRecord& record) { emergencyRecord(record); }))
+                {
+                    logger.retiredRecords.fetch_add(1, std::memory_order_release);
+                }
+            }
+
+            for (size_t index = 0;; index++)
+            {
+                Logger* current = index == 0 ? &logger : registered(index - 1);
+                if (current == nullptr) break;
+                if (current != &logger && !current->ownsSinks) continue;
+
+                const SinkTable* table = current->sinks.load(std::memory_order_acquire);
+                for (size_t i = 0; i < table->count; i++) table->entries[i].sink->emergencyFlush();
+            }
+        }
+
+        static std::atomic<bool> crashHandled(false);
+        static std::atomic<bool> crashHandlerInstalled(false);
+
+        #if defined(PLATFORM_WINDOWS)
+
+        static const int CRASH_SIGNALS[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL };
+
+        static void onCrash(int signal)
+        {
+            if (!crashHandled.exchange(true)) Logger::emergencyFlush();
+
+            ::signal(signal, SIG_DFL);
+            raise(signal);
+        }
+
+        void Logger::installCrashHandler()
+        {
+            if (crashHandlerInstalled.exchange(true)) return;
+
+            for (int crashSignal : CRASH_SIGNALS) ::signal(crashSignal, onCrash);
+        }
+
+        #else
+
+        static const int CRASH_SIGNALS[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+        static const size_t CRASH_SIGNAL_COUNT = sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
+
+        static struct sigaction previousActions[CRASH_SIGNAL_COUNT];
+
+        // Lets the handler run after a stack overflow on the installing thread.
+        static char alternateStack[64 * 1024];
+
+        // Once the records are saved, the previous disposition, normally the default action,
+        // gets the signal as soon as this handler returns.
+        static void onCrash(int signal)
+        {
+            if (!crashHandled.exchange(true)) Logger::emergencyFlush();
+
+            for (size_t i = 0; i < CRASH_SIGNAL_COUNT; i++)
+            {
+                if (CRASH_SIGNALS[i] == signal) sigaction(signal, &previousActions[i], nullptr);
+            }
+
+            raise(signal);
+        }
+
+        void Logger::installCrashHandler()
+        {
+            if (crashHandlerInstalled.exchange(true)) return;
+
+            stack_t stack;
+            memset(&stack, 0, sizeof(stack));
+            stack.ss_sp = alternateStack;
+            stack.ss_size = sizeof(alternateStack);
+            sigaltstack(&stack, nullptr);
+
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = onCrash;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_ONSTACK;
+
+            for (size_t i = 0; i < CRASH_SIGNAL_COUNT; i++) sigaction(CRASH_SIGNALS[i], &action, &previousActions[i]);
+        }
+
+        #endif
+    }
+}
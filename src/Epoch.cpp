@@ -0,0 +1,148 @@
+#include "AKL/Epoch.hpp"
+#include <atomic>
+#include <mutex>
+
+namespace AK
+{
+    namespace Log
+    {
+        // Each reading thread announces the global epoch it saw in a slot of its own; 0 means
+        // it is outside any guard. Threads beyond MAX_READERS share a counter instead, which
+        // holds back all reclamation while it is non-zero.
+        static const size_t MAX_READERS = 256;
+
+        struct alignas(64) ReaderEpoch
+        {
+            std::atomic<uint64_t> epoch;
+            std::atomic<bool> taken;
+        };
+
+        static std::atomic<uint64_t> globalEpoch(1);
+        static ReaderEpoch readerEpochs[MAX_READERS];
+        static std::atomic<uint32_t> unslottedReaders(0);
+
+        struct ReaderSlot
+        {
+            ReaderSlot()
+                : index(-1), depth(0)
+            {
+                for (size_t i = 0; i < MAX_READERS; i++)
+                {
+                    if (!readerEpochs[i].taken.exchange(true, std::memory_order_acquire))
+                    {
+                        index = (int)i;
+                        return;
+                    }
+                }
+            }
+
+            ~ReaderSlot()
+            {
+                if (index >= 0) readerEpochs[index].taken.store(false, std::memory_order_release);
+            }
+
+            int index;
+            uint32_t depth;
+        };
+
+        static thread_local ReaderSlot readerSlot;
+
+        struct Retired
+        {
+            void* object;
+            void (*destroy)(void*);
+            uint64_t epoch;
+            Retired* next;
+        };
+
+        static std::mutex retiredMutex;
+        static Retired* retiredList = nullptr;
+
+        EpochGuard::EpochGuard()
+        {
+            ReaderSlot& slot = readerSlot;
+            if (slot.depth++ > 0) return;
+
+            if (slot.index < 0) unslottedReaders.fetch_add(1, std::memory_order_seq_cst);
+            else readerEpochs[slot.index].epoch.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+
+        EpochGuard::~EpochGuard()
+        {
+            ReaderSlot& slot = readerSlot;
+            if (--slot.depth > 0) return;
+
+            if (slot.index < 0) unslottedReaders.fetch_sub(1, std::memory_order_release);
+            else readerEpochs[slot.index].epoch.store(0, std::memory_order_release);
+        }
+
+        // A reader that announced an epoch at or after retiredAt entered after the swap and
+        // cannot hold the old pointer.
+        static bool quiescent(uint64_t retiredAt)
+        {
+            if (unslottedReaders.load(std::memory_order_seq_cst) != 0) return false;
+
+            for (size_t i = 0; i < MAX_READERS; i++)
+            {
+                uint64_t epoch = readerEpochs[i].epoch.load(std::memory_order_seq_cst);
+                if (epoch != 0 && epoch < retiredAt) return false;
+            }
+
+            return true;
+        }
+
+        void retire(void* object, void (*destroy)(void*))
+        {
+            Retired* retired = new Retired;
+            retired->object = object;
+            retired->destroy = destroy;
+            retired->epoch = globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+            {
+                std::lock_guard<std::mutex> lock(retiredMutex);
+                retired->next = retiredList;
+                retiredList = retired;
+            }
+
+            reclaim();
+        }
+
+        size_t reclaim()
+        {
+            Retired* ready = nullptr;
+            size_t pending = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(retiredMutex);
+                Retired** link = &retiredList;
+
+                while (*link != nullptr)
+                {
+                    Retired* retired = *link;
+
+                    if (quiescent(retired->epoch))
+                    {
+                        *link = retired->next;
+                        retired->next = ready;
+                        ready = retired;
+                    }
+                    else
+                    {
+                        link = &retired->next;
+                        pending++;
+                    }
+                }
+            }
+
+            while (ready != nullptr)
+            {
+                Retired* retired = ready;
+                ready = retired->next;
+                retired->destroy(retired->object);
+                delete retired;
+            }
+
+            return pending;
+        }
+    }
+}
@@ -0,0 +1,632 @@
+#include "AKL/Format.hpp"
+#include "AKL/Binary.hpp"
+#include <charconv>
+#include <math.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        struct FieldSpec
+        {
+            bool left;
+            bool plus;
+            bool space;
+            bool zero;
+            bool alternate;
+            size_t width;
+            int precision;
+            char conversion;
+        };
+
+        static const FieldSpec DEFAULT_FIELD = { false, false, false, false, false, 0, -1, 0 };
+
+        static thread_local RecordBuffer<char> fieldBuffer;
+        static thread_local RecordBuffer<wchar_t> fieldBufferW;
+
+        static RecordBuffer<char>& scratchBuffer(const RecordBuffer<char>&) { return fieldBuffer; }
+        static RecordBuffer<wchar_t>& scratchBuffer(const RecordBuffer<wchar_t>&) { return fieldBufferW; }
+
+        static int64_t starValue(const FormatArg& arg)
+        {
+            return arg.type == FORMAT_ARG_UINT ? (int64_t)arg.u : arg.i;
+        }
+
+        // Reads the flags, width and precision of a conversion; '*' takes the next argument.
+        template<typename CharT>
+        static FieldSpec parseField(const CharT* text, const ConversionSpec& conversion, const FormatArg* args, size_t& next)
+        {
+            FieldSpec spec = DEFAULT_FIELD;
+            const CharT* options = text + conversion.optionsStart;
+            size_t i = 0;
+
+            for (; i < conversion.optionsLength; i++)
+            {
+                if (options[i] == '-') spec.left = true;
+                else if (options[i] == '+') spec.plus = true;
+                else if (options[i] == ' ') spec.space = true;
+                else if (options[i] == '0') spec.zero = true;
+                else if (options[i] == '#') spec.alternate = true;
+                else if (options[i] != '\'') break;
+            }
+
+            if (options[i] == '*')
+            {
+                int64_t width = starValue(args[next++]);
+                if (width < 0)
+                {
+                    spec.left = true;
+                    width = -width;
+                }
+                spec.width = (size_t)width;
+                i++;
+            }
+            for (; options[i] >= '0' && options[i] <= '9'; i++) spec.width = spec.width * 10 + (options[i] - '0');
+
+            if (options[i] == '.')
+            {
+                i++;
+                spec.precision = 0;
+
+                if (options[i] == '*')
+                {
+                    int64_t precision = starValue(args[next++]);
+                    spec.precision = precision < 0 ? -1 : (int)precision;
+                    i++;
+                }
+                for (; options[i] >= '0' && options[i] <= '9'; i++) spec.precision = spec.precision * 10 + (options[i] - '0');
+            }
+
+            spec.conversion = conversion.conversion;
+            return spec;
+        }
+
+        static void appendChars(RecordBuffer<char>& out, const char* text, size_t length)
+        {
+            out.append(text, length);
+        }
+
+        static void appendChars(RecordBuffer<wchar_t>& out, const char* text, size_t length)
+        {
+            out.appendAscii(text, length);
+        }
+
+        // Writes prefix, leading zeros and an ASCII body padded to the field width.
+        template<typename CharT>
+        static void appendField(RecordBuffer<CharT>& out, const char* prefix, size_t prefixLength, size_t zeros,
+                                const char* body, size_t bodyLength, const FieldSpec& spec, bool zeroPad)
+        {
+            size_t total = prefixLength + zeros + bodyLength;
+            size_t padding = spec.width > total ? spec.width - total : 0;
+
+            if (spec.left)
+            {
+                appendChars(out, prefix, prefixLength);
+                out.appendRepeat('0', zeros);
+                appendChars(out, body, bodyLength);
+                out.appendRepeat(' ', padding);
+            }
+            else if (spec.zero && zeroPad)
+            {
+                appendChars(out, prefix, prefixLength);
+                out.appendRepeat('0', zeros + padding);
+                appendChars(out, body, bodyLength);
+            }
+            else
+            {
+                out.appendRepeat(' ', padding);
+                appendChars(out, prefix, prefixLength);
+                out.appendRepeat('0', zeros);
+                appendChars(out, body, bodyLength);
+            }
+        }
+
+        template<typename CharT>
+        static void formatInteger(RecordBuffer<CharT>& out, const FormatArg& arg, const FieldSpec& spec)
+        {
+            char digits[24];
+            char prefix[2];
+            size_t prefixLength = 0;
+            size_t length = 0;
+
+            char conversion = spec.conversion;
+            bool isSigned = conversion == 'd' || conversion == 'i';
+            int base = conversion == 'o' ? 8 : (conversion == 'x' || conversion == 'X') ? 16 : 10;
+
+            uint64_t raw = arg.type == FORMAT_ARG_UINT ? arg.u : (uint64_t)arg.i;
+            uint64_t magnitude = raw;
+            bool negative = false;
+
+            if (isSigned && arg.type != FORMAT_ARG_UINT && arg.i < 0)
+            {
+                negative = true;
+                magnitude = 0 - raw;
+            }
+            else if (!isSigned && arg.size < 8)
+            {
+                magnitude = raw & ((1ull << (arg.size * 8)) - 1);
+            }
+
+            if (spec.precision != 0 || magnitude != 0)
+            {
+                length = std::to_chars(digits, digits + sizeof(digits), magnitude, base).ptr - digits;
+                if (conversion == 'X') for (size_t i = 0; i < length; i++) if (digits[i] >= 'a') digits[i] -= 'a' - 'A';
+            }
+
+            if (negative) prefix[prefixLength++] = '-';
+            else if (isSigned && spec.plus) prefix[prefixLength++] = '+';
+            else if (isSigned && spec.space) prefix[prefixLength++] = ' ';
+
+            if (spec.alternate && base == 16 && magnitude != 0)
+            {
+                prefix[prefixLength++] = '0';
+                prefix[prefixLength++] = conversion;
+            }
+
+            size_t zeros = spec.precision > (int)length ? spec.precision - length : 0;
+            if (spec.alternate && base == 8 && zeros == 0 && (length == 0 || digits[0] != '0')) zeros = 1;
+
+            appendField(out, prefix, prefixLength, zeros, digits, length, spec, spec.precision < 0);
+        }
+
+        // Conversions to_chars has no equivalent for ('#' and hex floats) go through snprintf.
+        template<typename CharT>
+        static void formatFloatFallback(RecordBuffer<CharT>& out, double value, const FieldSpec& spec)
+        {
+            char conversion[16];
+            size_t length = 0;
+
+            conversion[length++] = '%';
+            if (spec.left) conversion[length++] = '-';
+            if (spec.plus) conversion[length++] = '+';
+            if (spec.space) conversion[length++] = ' ';
+            if (spec.zero) conversion[length++] = '0';
+            if (spec.alternate) conversion[length++] = '#';
+            conversion[length++] = '*';
+            conversion[length++] = '.';
+            conversion[length++] = '*';
+            conversion[length++] = spec.conversion != 0 ? spec.conversion : 'g';
+            conversion[length] = '\0';
+
+            // A negative precision is taken as omitted, which keeps %a exact.
+            char text[512];
+            int written = snprintf(text, sizeof(text), conversion, (int)spec.width, spec.precision, value);
+            if (written < 0) return;
+
+            if ((size_t)written < sizeof(text))
+            {
+                appendChars(out, text, written);
+                return;
+            }
+
+            char* large = (char*)malloc(written + 1);
+            if (large == nullptr) return;
+
+            snprintf(large, written + 1, conversion, (int)spec.width, spec.precision, value);
+            appendChars(out, large, written);
+            free(large);
+        }
+
+        template<typename CharT>
+        static void formatFloat(RecordBuffer<CharT>& out, double value, const FieldSpec& spec)
+        {
+            char conversion = spec.conversion;
+
+            if (spec.alternate || conversion == 'a' || conversion == 'A')
+            {
+                formatFloatFallback(out, value, spec);
+                return;
+            }
+
+            char digits[512];
+            char prefix[1];
+            size_t prefixLength = 0;
+            bool negative = signbit(value);
+            double magnitude = negative ? -value : value;
+            std::to_chars_result result;
+
+            if (conversion == 0)
+            {
+                result = std::to_chars(digits, digits + sizeof(digits), magnitude);
+            }
+            else
+            {
+                int precision = spec.precision < 0 ? 6 : spec.precision;
+                std::chars_format format = std::chars_format::general;
+
+                if (conversion == 'f' || conversion == 'F') format = std::chars_format::fixed;
+                else if (conversion == 'e' || conversion == 'E') format = std::chars_format::scientific;
+
+                result = std::to_chars(digits, digits + sizeof(digits), magnitude, format, precision);
+            }
+
+            if (result.ec != std::errc())
+            {
+                formatFloatFallback(out, value, spec);
+                return;
+            }
+
+            size_t length = result.ptr - digits;
+            if (conversion == 'F' || conversion == 'E' || conversion == 'G')
+            {
+                for (size_t i = 0; i < length; i++) if (digits[i] >= 'a' && digits[i] <= 'z') digits[i] -= 'a' - 'A';
+            }
+
+            if (negative) prefix[prefixLength++] = '-';
+            else if (spec.plus) prefix[prefixLength++] = '+';
+            else if (spec.space) prefix[prefixLength++] = ' ';
+
+            appendField(out, prefix, prefixLength, 0, digits, length, spec, isfinite(value));
+        }
+
+        static void appendCodePoint(RecordBuffer<char>& out, uint32_t codePoint)
+        {
+            char bytes[4];
+            out.append(bytes, encodeUtf8(codePoint, bytes));
+        }
+
+        static void appendCodePoint(RecordBuffer<wchar_t>& out, uint32_t codePoint)
+        {
+            if (sizeof(wchar_t) == 2 && codePoint >= 0x10000 && codePoint < 0x110000)
+            {
+                wchar_t pair[2] = { (wchar_t)(0xD800 + ((codePoint - 0x10000) >> 10)), (wchar_t)(0xDC00 + (codePoint & 0x3FF)) };
+                out.append(pair, 2);
+                return;
+            }
+
+            wchar_t c = (wchar_t)codePoint;
+            out.append(&c, 1);
+        }
+
+        // A narrow record takes %c of anything but a wide character as a single byte, as printf does.
+        static void appendCharacter(RecordBuffer<char>& out, const FormatArg& arg)
+        {
+            if (arg.type == FORMAT_ARG_CHAR && arg.size > 1)
+            {
+                appendCodePoint(out, (uint32_t)arg.i);
+                return;
+            }
+
+            char c = (char)arg.i;
+            out.append(&c, 1);
+        }
+
+        static void appendCharacter(RecordBuffer<wchar_t>& out, const FormatArg& arg)
+        {
+            appendCodePoint(out, arg.size == 1 ? (uint32_t)(uint8_t)arg.i : (uint32_t)arg.i);
+        }
+
+        static void appendString(RecordBuffer<char>& out, const FormatArg& arg)
+        {
+            if (arg.type == FORMAT_ARG_STRING) out.append(arg.text, arg.length);
+            else appendUtf8(out, arg.textW, arg.length);
+        }
+
+        static void appendString(RecordBuffer<wchar_t>& out, const FormatArg& arg)
+        {
+            if (arg.type == FORMAT_ARG_WSTRING) out.append(arg.textW, arg.length);
+            else appendWide(out, arg.text, arg.length);
+        }
+
+        // Strings and characters are transcoded to the output's width; a field with a width
+        // or precision is assembled in a scratch buffer first so it can be cut and padded.
+        template<typename CharT>
+        static void formatText(RecordBuffer<CharT>& out, const FormatArg& arg, const FieldSpec& spec)
+        {
+            bool isNull = (arg.type == FORMAT_ARG_STRING || arg.type == FORMAT_ARG_WSTRING) && arg.pointer == nullptr;
+
+            if (spec.width == 0 && spec.precision < 0)
+            {
+                if (isNull) out.appendAscii("(null)");
+                else if (arg.type == FORMAT_ARG_STRING || arg.type == FORMAT_ARG_WSTRING) appendString(out, arg);
+                else appendCharacter(out, arg);
+                return;
+            }
+
+            RecordBuffer<CharT>& scratch = scratchBuffer(out);
+            scratch.clear();
+
+            if (isNull) scratch.appendAscii("(null)");
+            else if (arg.type == FORMAT_ARG_STRING || arg.type == FORMAT_ARG_WSTRING) appendString(scratch, arg);
+            else appendCharacter(scratch, arg);
+
+            size_t length = scratch.size();
+            if (spec.precision >= 0 && (size_t)spec.precision < length && arg.type != FORMAT_ARG_CHAR) length = spec.precision;
+
+            size_t padding = spec.width > length ? spec.width - length : 0;
+            if (!spec.left) out.appendRepeat(' ', padding);
+            out.append(scratch.data(), length);
+            if (spec.left) out.appendRepeat(' ', padding);
+        }
+
+        // A null pointer prints as glibc's "(nil)".
+        template<typename CharT>
+        static void formatPointer(RecordBuffer<CharT>& out, const void* pointer, const FieldSpec& spec)
+        {
+            if (pointer == nullptr)
+            {
+                appendField(out, "", 0, 0, "(nil)", 5, spec, false);
+                return;
+            }
+
+            char digits[24];
+            size_t length = std::to_chars(digits, digits + sizeof(digits), (uintptr_t)pointer, 16).ptr - digits;
+
+            appendField(out, "0x", 2, 0, digits, length, spec, false);
+        }
+
+        template<typename CharT>
+        static void formatValue(RecordBuffer<CharT>& out, const FormatArg& arg, FieldSpec spec)
+        {
+            bool isIntegral = isIntegralArg(arg.type);
+            bool isString = arg.type == FORMAT_ARG_STRING || arg.type == FORMAT_ARG_WSTRING;
+
+            switch (spec.conversion)
+            {
+                case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+                    if (isIntegral) return formatInteger(out, arg, spec);
+                    break;
+                case 'c': case 'C':
+                    if (isIntegral) return formatText(out, arg, spec);
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    if (arg.type == FORMAT_ARG_DOUBLE) return formatFloat(out, arg.d, spec);
+                    break;
+                case 's': case 'S':
+                    if (isString) return formatText(out, arg, spec);
+                    break;
+                case 'p':
+                    if (arg.type == FORMAT_ARG_POINTER || isString) return formatPointer(out, arg.pointer, spec);
+                    break;
+            }
+
+            // "{}" and mismatched conversions from unchecked call sites use the argument's own type.
+            switch (arg.type)
+            {
+                case FORMAT_ARG_BOOL:
+                {
+                    const char* text = arg.i != 0 ? "true" : "false";
+                    appendField(out, "", 0, 0, text, strlen(text), spec, false);
+                    break;
+                }
+                case FORMAT_ARG_CHAR:
+                    formatText(out, arg, spec);
+                    break;
+                case FORMAT_ARG_INT:
+                    spec.conversion = 'd';
+                    formatInteger(out, arg, spec);
+                    break;
+                case FORMAT_ARG_UINT:
+                    spec.conversion = 'u';
+                    formatInteger(out, arg, spec);
+                    break;
+                case FORMAT_ARG_DOUBLE:
+                    spec.conversion = 0;
+                    formatFloat(out, arg.d, spec);
+                    break;
+                case FORMAT_ARG_STRING:
+                case FORMAT_ARG_WSTRING:
+                    formatText(out, arg, spec);
+                    break;
+                case FORMAT_ARG_POINTER:
+                    formatPointer(out, arg.pointer, spec);
+                    break;
+                case FORMAT_ARG_NONE:
+                    break;
+            }
+        }
+
+        static void appendRun(RecordBuffer<char>& out, const char* text, size_t length)
+        {
+            out.append(text, length);
+        }
+
+        static void appendRun(RecordBuffer<char>& out, const wchar_t* text, size_t length)
+        {
+            appendUtf8(out, text, length);
+        }
+
+        static void appendRun(RecordBuffer<wchar_t>& out, const wchar_t* text, size_t length)
+        {
+            out.append(text, length);
+        }
+
+        // Renders a format of either width into the output buffer. printf formats coming from
+        // a va_list leave "{}" and doubled braces alone.
+        template<typename CharT, typename OutT>
+        static void renderMessage(RecordBuffer<OutT>& out, const CharT* text, const FormatArg* args, size_t count, bool placeholders)
+        {
+            size_t next = 0;
+            size_t literalStart = 0;
+            size_t i = 0;
+
+            while (text[i] != 0)
+            {
+                CharT c = text[i];
+
+                if (placeholders && (c == '{' || c == '}') && text[i + 1] == c)
+                {
+                    appendRun(out, text + literalStart, i + 1 - literalStart);
+                    i += 2;
+                    literalStart = i;
+                    continue;
+                }
+
+                if (placeholders && c == '{' && text[i + 1] == '}' && next < count)
+                {
+                    appendRun(out, text + literalStart, i - literalStart);
+                    formatValue(out, args[next++], DEFAULT_FIELD);
+                    i += 2;
+                    literalStart = i;
+                    continue;
+                }
+
+                if (c != '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                if (text[i + 1] == '%')
+                {
+                    appendRun(out, text + literalStart, i + 1 - literalStart);
+                    i += 2;
+                    literalStart = i;
+                    continue;
+                }
+
+                ConversionSpec conversion;
+                if (!parseConversion(text + i, conversion) || !isFormatConversion(conversion.conversion) ||
+                    next + conversion.widthStar + conversion.precisionStar + 1 > count)
+                {
+                    i++;
+                    continue;
+                }
+
+                appendRun(out, text + literalStart, i - literalStart);
+
+                FieldSpec spec = parseField(text + i, conversion, args, next);
+                FormatArg arg = args[next++];
+
+                // h and hh narrow integer conversions as the va_list path does when capturing.
+                bool integerConversion = spec.conversion == 'd' || spec.conversion == 'i' || spec.conversion == 'o' ||
+                                         spec.conversion == 'u' || spec.conversion == 'x' || spec.conversion == 'X';
+                if (integerConversion && isIntegralArg(arg.type) && conversion.lengthModifier[0] == 'h')
+                {
+                    int64_t value = arg.type == FORMAT_ARG_UINT ? (int64_t)arg.u : arg.i;
+                    arg = conversion.lengthModifier[1] == 'h' ? makeFormatArg((signed char)value) : makeFormatArg((short)value);
+                }
+
+                // %c in a wide format takes a code point whatever the argument type.
+                if (sizeof(CharT) > 1 && (spec.conversion == 'c' || spec.conversion == 'C') && arg.type != FORMAT_ARG_CHAR)
+                {
+                    arg.type = FORMAT_ARG_CHAR;
+                    arg.size = 4;
+                }
+
+                if (spec.conversion != 'n') formatValue(out, arg, spec);
+
+                i += conversion.length;
+                literalStart = i;
+            }
+
+            appendRun(out, text + literalStart, i - literalStart);
+        }
+
+        // Reads the arguments of a printf format off a va_list with the types the platform's
+        // printf would use.
+        template<typename CharT>
+        static bool captureVarArgs(const CharT* text, va_list args, FormatArg* out, size_t& count)
+        {
+            bool wide = sizeof(CharT) > 1;
+            count = 0;
+
+            for (size_t i = 0; text[i] != 0; i++)
+            {
+                if (text[i] != '%') continue;
+
+                if (text[i + 1] == '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                ConversionSpec spec;
+                if (!parseConversion(text + i, spec)) break;
+                i += spec.length - 1;
+
+                if (count + spec.widthStar + spec.precisionStar + 1 > FORMAT_MAX_VARARGS) return false;
+
+                if (spec.widthStar) out[count++] = makeFormatArg(va_arg(args, int));
+                if (spec.precisionStar) out[count++] = makeFormatArg(va_arg(args, int));
+
+                switch (conversionArgType(spec, wide))
+                {
+                    case ARG_INT32:
+                    {
+                        int value = va_arg(args, int);
+
+                        if (spec.lengthModifier[0] == 'h' && spec.lengthModifier[1] == 'h') out[count++] = makeFormatArg((signed char)value);
+                        else if (spec.lengthModifier[0] == 'h') out[count++] = makeFormatArg((short)value);
+                        else out[count++] = makeFormatArg(value);
+                        break;
+                    }
+                    case ARG_INT64:
+                        out[count++] = makeFormatArg(va_arg(args, long long));
+                        break;
+                    case ARG_DOUBLE:
+                        out[count++] = makeFormatArg(va_arg(args, double));
+                        break;
+                    case ARG_LONG_DOUBLE:
+                        out[count++] = makeFormatArg(va_arg(args, long double));
+                        break;
+                    case ARG_POINTER:
+                    case ARG_IGNORED:
+                        out[count++] = makeFormatArg(va_arg(args, void*));
+                        break;
+                    case ARG_CHAR:
+                        out[count++] = makeFormatArg(va_arg(args, int));
+                        break;
+                    case ARG_WCHAR:
+                        out[count++] = makeFormatArg((wchar_t)va_arg(args, wint_t));
+                        break;
+                    case ARG_STRING:
+                        out[count++] = makeFormatArg(va_arg(args, const char*));
+                        break;
+                    case ARG_WSTRING:
+                        out[count++] = makeFormatArg(va_arg(args, const wchar_t*));
+                        break;
+                    case ARG_NONE:
+                        break;
+                }
+            }
+
+            return true;
+        }
+
+        template<typename CharT, typename OutT>
+        static bool renderVarArgs(RecordBuffer<OutT>& out, const CharT* text, va_list args)
+        {
+            FormatArg captured[FORMAT_MAX_VARARGS];
+            size_t count;
+            va_list copy;
+
+            va_copy(copy, args);
+            bool captures = captureVarArgs(text, copy, captured, count);
+            va_end(copy);
+
+            if (captures) renderMessage(out, text, captured, count, false);
+            return captures;
+        }
+
+        void formatMessage(RecordBuffer<char>& out, const char* text, const FormatArg* args, size_t count)
+        {
+            renderMessage(out, text, args, count, true);
+        }
+
+        void formatArg(RecordBuffer<char>& out, const FormatArg& arg)
+        {
+            formatValue(out, arg, DEFAULT_FIELD);
+        }
+
+        void formatMessage(RecordBuffer<char>& out, const wchar_t* text, const FormatArg* args, size_t count)
+        {
+            renderMessage(out, text, args, count, true);
+        }
+
+        void formatMessage(RecordBuffer<wchar_t>& out, const wchar_t* text, const FormatArg* args, size_t count)
+        {
+            renderMessage(out, text, args, count, true);
+        }
+
+        bool formatVarArgs(RecordBuffer<char>& out, const char* text, va_list args)
+        {
+            return renderVarArgs(out, text, args);
+        }
+
+        bool formatVarArgs(RecordBuffer<char>& out, const wchar_t* text, va_list args)
+        {
+            return renderVarArgs(out, text, args);
+        }
+    }
+}
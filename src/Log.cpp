@@ -1,689 +1,1115 @@
 #include "AKL/log.hpp"
+#include "AKL/RecordBuffer.hpp"
+#include "AKL/Structured.hpp"
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
 #include <string.h>
-#include <io.h>
-#include <fcntl.h>
+#include <stdlib.h>
+#include <chrono>
 
 namespace AK 
 {
     namespace Log 
     {
+        static void addToken(FormatProgram& program, FormatTokenType type, size_t offset, size_t length)
+        {
+            if (type == TOKEN_LITERAL && length == 0) return;
+
+            FormatToken& token = program.tokens[program.count++];
+            token.type = type;
+            token.offset = (uint32_t)offset;
+            token.length = (uint32_t)length;
+        }
+
+        // Splits a layout into literal runs and % directives once, so records only replay the
+        // token list. Unknown directives and a trailing '%' produce nothing, as before. A layout
+        // with more than FormatProgram::MAX_TOKENS tokens keeps its tail as one raw literal.
+        template<typename CharT>
+        static void compileFormat(const CharT* fmt, FormatProgram& program)
+        {
+            size_t i = 0;
+            size_t literalStart = 0;
+            program.count = 0;
+
+            while (fmt[i] != 0)
+            {
+                if (fmt[i] != '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                if (program.count + 2 >= FormatProgram::MAX_TOKENS) break;
+
+                addToken(program, TOKEN_LITERAL, literalStart, i - literalStart);
+
+                CharT c = fmt[i + 1];
+
+                switch (c)
+                {
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8':
+                        addToken(program, TOKEN_COLOR, c - '0', 0);
+                        break;
+                    case 't':
+                        addToken(program, TOKEN_TIME, 0, 0);
+                        break;
+                    case 'd':
+                        addToken(program, TOKEN_DATE, 0, 0);
+                        break;
+                    case 'l':
+                        addToken(program, TOKEN_LEVEL, 0, 0);
+                        break;
+                    case 'm':
+                        addToken(program, TOKEN_ENCODING, 0, 0);
+                        break;
+                    case 'r':
+                        addToken(program, TOKEN_SAMPLE_RATE, 0, 0);
+                        break;
+                    case 's':
+                        addToken(program, TOKEN_MESSAGE, 0, 0);
+                        break;
+                }
+
+                i += c == 0 ? 1 : 2;
+                literalStart = i;
+            }
+
+            while (fmt[i] != 0) i++;
+            addToken(program, TOKEN_LITERAL, literalStart, i - literalStart);
+        }
+
+        template<typename CharT>
+        static void writeDigits(CharT* dest, int value, int count)
+        {
+            for (int i = count - 1; i >= 0; i--)
+            {
+                dest[i] = (CharT)('0' + value % 10);
+                value /= 10;
+            }
+        }
+
+        // The date and time strings of the last second this thread stamped a record with.
+        // localtime only runs when a record falls into a new second.
+        struct TimestampCache
+        {
+            int64_t second;
+            char date[11];
+            char time[9];
+        };
+
+        static thread_local TimestampCache timestampCache = { INT64_MIN, {}, {} };
+
+        static const TimestampCache& cachedTimestamp(int64_t timestamp)
+        {
+            TimestampCache& cache = timestampCache;
+            int64_t second = timestamp / 1000000;
+
+            if (cache.second == second) return cache;
+
+            time_t t = (time_t)second;
+            struct tm lt;
+
+            #if defined(PLATFORM_WINDOWS)
+            localtime_s(&lt, &t);
+            #else
+            localtime_r(&t, &lt);
+            #endif
+
+            writeDigits(cache.date, lt.tm_year + 1900, 4);
+            cache.date[4] = '/';
+            writeDigits(cache.date + 5, lt.tm_mon + 1, 2);
+            cache.date[7] = '/';
+            writeDigits(cache.date + 8, lt.tm_mday, 2);
+            cache.date[10] = '\0';
+
+            writeDigits(cache.time, lt.tm_hour, 2);
+            cache.time[2] = ':';
+            writeDigits(cache.time + 3, lt.tm_min, 2);
+            cache.time[5] = ':';
+            writeDigits(cache.time + 6, lt.tm_sec, 2);
+            cache.time[8] = '\0';
+
+            cache.second = second;
+            return cache;
+        }
+
+        // Every record is assembled as UTF-8, whatever the width of its format strings.
+        static thread_local RecordBuffer<char> recordBuffer;
+
+        // Wide printf messages with more arguments than the formatter captures are rendered
+        // here and transcoded; async producers render into messageBuffer before copying it to
+        // a queue slot.
+        static thread_local RecordBuffer<wchar_t> messageBufferW;
+        static thread_local RecordBuffer<char> messageBuffer;
+
+        // A message rendered once for several layouts, and the copy of a record without its
+        // color escapes for sinks that do not want them.
+        static thread_local RecordBuffer<char> sharedMessage;
+        static thread_local RecordBuffer<char> plainBuffer;
+
+        // The key/value fields of the record being submitted, packed as described in
+        // Structured.hpp, and a message waiting to be escaped for a structured sink.
+        static thread_local RecordBuffer<char> packedFields;
+        static thread_local RecordBuffer<char> structuredMessage;
+
+        // Where printColor() put escapes in recordBuffer, or with enabled unset, that the
+        // record is rendered for colorless sinks only.
+        struct ColorSpans
+        {
+            static const size_t MAX_SPANS = FormatProgram::MAX_TOKENS + 2;
+
+            bool enabled;
+            size_t count;
+            uint32_t offsets[MAX_SPANS];
+            uint32_t lengths[MAX_SPANS];
+        };
+
+        static thread_local ColorSpans colorSpans;
+
+        static void stripColors(const RecordBuffer<char>& record, const ColorSpans& spans, RecordBuffer<char>& plain)
+        {
+            size_t start = 0;
+            plain.clear();
+
+            for (size_t i = 0; i < spans.count; i++)
+            {
+                plain.append(record.data() + start, spans.offsets[i] - start);
+                start = spans.offsets[i] + spans.lengths[i];
+            }
+
+            plain.append(record.data() + start, record.size() - start);
+        }
+
+        static void appendText(RecordBuffer<char>& buffer, const char* text, size_t length)
+        {
+            buffer.append(text, length);
+        }
+
+        static void appendText(RecordBuffer<char>& buffer, const wchar_t* text, size_t length)
+        {
+            appendUtf8(buffer, text, length);
+        }
+
+        static void appendFormatted(RecordBuffer<char>& buffer, const char* text, va_list args)
+        {
+            if (!formatVarArgs(buffer, text, args)) buffer.appendFormat(text, args);
+        }
+
+        static void appendFormatted(RecordBuffer<char>& buffer, const wchar_t* text, va_list args)
+        {
+            if (formatVarArgs(buffer, text, args)) return;
+
+            RecordBuffer<wchar_t>& message = messageBufferW;
+            message.clear();
+            message.appendFormat(text, args);
+            appendUtf8(buffer, message.data(), message.size());
+        }
+
+        template<typename CharT>
+        static void printSubsecond(RecordBuffer<CharT>& buffer, int64_t timestamp, TimePrecision precision)
+        {
+            CharT digits[7];
+            int micros = (int)(timestamp % 1000000);
+            digits[0] = '.';
+
+            switch (precision)
+            {
+                case PRECISION_SECONDS:
+                    return;
+                case PRECISION_MILLISECONDS:
+                    writeDigits(digits + 1, micros / 1000, 3);
+                    buffer.append(digits, 4);
+                    break;
+                case PRECISION_MICROSECONDS:
+                    writeDigits(digits + 1, micros, 6);
+                    buffer.append(digits, 7);
+                    break;
+            }
+        }
+
+        static ConsoleSink consoleSink;
+
         #if defined(PLATFORM_WINDOWS)
 
         Logger::Logger() 
-            : fmt("[%l %t]: %s\n"), fmtW(L"[%l %t]: %s\n"), level(WarningLevel::LEVEL_INFO), handle(GetStdHandle(STD_OUTPUT_HANDLE))
+            : fmt("[%l %t]: %s\n"), fmtW(L"[%l %t]: %s\n"), level(WarningLevel::LEVEL_INFO), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE), handle(GetStdHandle(STD_OUTPUT_HANDLE))
         {
-            if (FORMAT_COLOR_RESET == -1) 
+            initSinks();
+
+            DWORD mode = 0;
+            if (GetConsoleMode(handle, &mode)) 
             {
-                CONSOLE_SCREEN_BUFFER_INFO info;
-                GetConsoleScreenBufferInfo(handle, &info);
-                FORMAT_COLOR_RESET = info.wAttributes;
+                SetConsoleMode(handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
             }
+
+            SetConsoleOutputCP(CP_UTF8);
         }
 
         Logger::Logger(const char* fmt, const wchar_t* fmtW)
-            : fmt(fmt), fmtW(fmtW), level(WarningLevel::LEVEL_INFO), handle(GetStdHandle(STD_OUTPUT_HANDLE))
+            : fmt(fmt), fmtW(fmtW), level(WarningLevel::LEVEL_INFO), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE), handle(GetStdHandle(STD_OUTPUT_HANDLE))
         {
-            if (FORMAT_COLOR_RESET == -1) 
+            initSinks();
+
+            DWORD mode = 0;
+            if (GetConsoleMode(handle, &mode)) 
             {
-                CONSOLE_SCREEN_BUFFER_INFO info;
-                GetConsoleScreenBufferInfo(handle, &info);
-                FORMAT_COLOR_RESET = info.wAttributes;
+                SetConsoleMode(handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
             }
+
+            SetConsoleOutputCP(CP_UTF8);
         }
 
         Logger::Logger(const char* fmt, const wchar_t* fmtW, WarningLevel _level)
-            : fmt(fmt), fmtW(fmtW), level(_level), handle(GetStdHandle(STD_OUTPUT_HANDLE))
+            : fmt(fmt), fmtW(fmtW), level(_level), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE), handle(GetStdHandle(STD_OUTPUT_HANDLE))
         {
-            if (FORMAT_COLOR_RESET == -1) 
+            initSinks();
+
+            DWORD mode = 0;
+            if (GetConsoleMode(handle, &mode)) 
             {
-                CONSOLE_SCREEN_BUFFER_INFO info;
-                GetConsoleScreenBufferInfo(handle, &info);
-                FORMAT_COLOR_RESET = info.wAttributes;
+                SetConsoleMode(handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
             }
+
+            SetConsoleOutputCP(CP_UTF8);
         }
 
         #else
 
         Logger::Logger() 
-            : fmt("[%l %t]: %s\n"), fmtW(L"[%l %t]: %s\n"), level(WarningLevel::LEVEL_INFO)
+            : fmt("[%l %t]: %s\n"), fmtW(L"[%l %t]: %s\n"), level(WarningLevel::LEVEL_INFO), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE)
         {
+            initSinks();
         }
 
         Logger::Logger(const char* fmt, const wchar_t* fmtW)
-            : fmt(fmt), fmtW(fmtW), level(WarningLevel::LEVEL_INFO)
+            : fmt(fmt), fmtW(fmtW), level(WarningLevel::LEVEL_INFO), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE)
         {
+            initSinks();
         }
 
         Logger::Logger(const char* fmt, const wchar_t* fmtW, WarningLevel _level)
-            : fmt(fmt), fmtW(fmtW), level(_level)
+            : fmt(fmt), fmtW(fmtW), level(_level), threshold(LEVEL_TRACE), sinks(nullptr), timePrecision(PRECISION_SECONDS),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(""), nameHash(0), parent(nullptr), root(this), sinkOwner(this), ownsSinks(true), configuredThreshold(LEVEL_TRACE)
         {
+            initSinks();
         }
 
         #endif
 
+        Logger::Logger(Logger* _parent, const char* _name, uint32_t _hash)
+            : fmt(_parent->fmt.load()), fmtW(_parent->fmtW.load()), level(_parent->level.load()), threshold(_parent->getThreshold()), sinks(nullptr), timePrecision(_parent->timePrecision.load()),
+              asyncQueue(nullptr), asyncCapacity(0), overflowPolicy(OVERFLOW_BLOCK), asyncRunning(false), writerSleeping(false), writerBusy(false), binarySink(nullptr), definedFormats(0),
+              pushedRecords(0), retiredRecords(0), queueHighWater(0), dropped(0),
+              name(_name), nameHash(_hash), parent(_parent), root(_parent->root), sinkOwner(_parent->sinkOwner.load()), ownsSinks(false), configuredThreshold(-1)
+              #if defined(PLATFORM_WINDOWS)
+              , handle(_parent->handle)
+              #endif
+        {
+            initSinks();
+        }
+
         Logger::~Logger()
         {
+            stopAsync();
+            delete sinks.load(std::memory_order_acquire);
         }
 
         void Logger::log(const char* text, va_list args)
         {
-            _setmode(_fileno(stdout), _O_TEXT);
-            printLevelColor();
-            printFmtArgs(fmt, text, args);
-            clearLevel();
+            log((WarningLevel)level.load(std::memory_order_relaxed), text, args);
         }
         
         void Logger::log(WarningLevel _level, const char* text, va_list args)
         {
-            _setmode(_fileno(stdout), _O_TEXT);
-            WarningLevel previousLevel = level;
-            setLevel(_level);
-            printLevelColor();
-            log(text, args);
-            level = previousLevel;
-            clearLevel();
+            if (!isEnabled(_level)) return;
+
+            submit(_level, false, text, nullptr, 0, [&](RecordBuffer<char>& out) { appendFormatted(out, text, args); });
         }
 
         void Logger::logMsg(const char* text, ...) 
         {
-            printLevelColor();
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log((WarningLevel)level.load(std::memory_order_relaxed), text, args);
             va_end(args);
-            clearLevel();
         }
 
         void Logger::logMsg(WarningLevel _level, const char* text, ...) 
         {
-            WarningLevel previousLevel = level;
-            setLevel(_level);
-            printLevelColor();
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(_level, text, args);
             va_end(args);
-            level = previousLevel;
-            clearLevel();
         }
         
         void Logger::logTrace(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_TRACE);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_TRACE, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logDebug(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_DEBUG);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_DEBUG, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logInfo(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_INFO);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_INFO, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logWarning(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_WARNING);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_WARNING, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logError(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_ERROR);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_ERROR, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logFatal(const char* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_FATAL);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_FATAL, text, args);
             va_end(args);
-            level = previousLevel;
         }
 
         void Logger::logAssert(const char* text, ...) 
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_ASSERT);
             va_list args;
             va_start(args, text);
-            log(text, args);
+            log(WarningLevel::LEVEL_ASSERT, text, args);
             va_end(args);
-            level = previousLevel;
+        }
+
+        void Logger::logFields(WarningLevel _level, const char* text, const FormatArg* fields, size_t count)
+        {
+            submit(_level, false, text, fields, count, [&](RecordBuffer<char>& out) { out.append(text); });
+        }
+
+        void Logger::logArgs(WarningLevel _level, const char* text, const FormatArg* args, size_t count)
+        {
+            submit(_level, false, text, nullptr, 0, [&](RecordBuffer<char>& out) { formatMessage(out, text, args, count); });
+        }
+
+        void Logger::logArgs(WarningLevel _level, const wchar_t* text, const FormatArg* args, size_t count)
+        {
+            submit(_level, true, text, nullptr, 0, [&](RecordBuffer<char>& out) { formatMessage(out, text, args, count); });
+        }
+
+        // Renders the message into a queue slot in async mode and into a record otherwise;
+        // wide calls only differ in the layout they are printed with. site is the call's
+        // format string for the rate limiter, nullptr to bypass it; fields holds fieldCount
+        // key/value pairs.
+        template<typename Render>
+        void Logger::submit(WarningLevel _level, bool wide, const void* site, const FormatArg* fields, size_t fieldCount, const Render& render)
+        {
+            SamplerState& sampler = samplerState();
+            uint32_t sampleRate = sampler.rate;
+            sampler.rate = 0;
+
+            {
+                EpochGuard guard;
+                if (_level < sinkOwner.load(std::memory_order_acquire)->sinks.load(std::memory_order_seq_cst)->lowest) return;
+            }
+
+            if (site != nullptr && rateInterval.load(std::memory_order_relaxed) != 0)
+            {
+                uint64_t repeats = 0;
+                if (!admitSite(_level, site, wide, repeats)) return;
+                if (repeats != 0) reportRepeats(_level, site, wide, repeats);
+            }
+
+            RecordBuffer<char>& packed = packedFields;
+            packed.clear();
+            for (size_t i = 0; i < fieldCount; i++) packField(packed, fields[i * 2], fields[i * 2 + 1]);
+
+            Record record = { _level, currentTimestamp(), sampleRate, packed.data(), (uint32_t)packed.size() };
+
+            // Queued records are only rendered once a sink has taken them, so the sinks are
+            // asked here rather than on the writer thread. Those are counted as emitted when the
+            // writer thread hands them to the sinks.
+            if (root->asyncRunning.load(std::memory_order_acquire))
+            {
+                SinkSelection selection;
+                {
+                    EpochGuard guard;
+                    const SinkTable* table = sinkOwner.load(std::memory_order_acquire)->sinks.load(std::memory_order_seq_cst);
+                    selection.generation = table->generation;
+                    selection.entries = selectSinks(table, record);
+                }
+
+                if (selection.entries != 0) root->pushAsync(this, record, selection, wide, render);
+                else ThreadCounters::local().countDeclined();
+            }
+            else if (emitMessage(record, wide, nullptr, nullptr, render)) ThreadCounters::local().countEmitted(_level);
+            else ThreadCounters::local().countDeclined();
+
+            // A FATAL or ASSERT record is likely the last one before the process goes down.
+            if (_level >= LEVEL_FATAL) flush();
+        }
+
+        // Stands in for the records a rate-limited site dropped since it last got through.
+        void Logger::reportRepeats(WarningLevel _level, const void* format, bool wide, uint64_t repeats)
+        {
+            submit(_level, wide, nullptr, nullptr, 0, [&](RecordBuffer<char>& out)
+            {
+                char count[64];
+                appendText(out, count, snprintf(count, sizeof(count), "last message repeated %llu times: ", (unsigned long long)repeats));
+
+                if (wide) appendText(out, (const wchar_t*)format, stringLength((const wchar_t*)format));
+                else appendText(out, (const char*)format, strlen((const char*)format));
+            });
         }
 
         void Logger::setLevel(WarningLevel _level) 
         {
-            level = _level;
+            level.store(_level, std::memory_order_relaxed);
         }
 
         void Logger::printFmt(const char* fmt, const char* text, ...)
         {
-            char c = 0;
-            int i = 0;
-            int currentObj = 0;
-            int length = strlen(fmt);
+            va_list args;
+            va_start(args, text);
+            printFmtArgs(fmt, text, args);
+            va_end(args);
+        }
+
+        // Goes to every sink that accepts the logger's default level, all with the given layout.
+        void Logger::printFmtArgs(const char* fmt, const char* text, va_list args)
+        {
+            Record record = { (WarningLevel)level.load(std::memory_order_relaxed), currentTimestamp(), 0, nullptr, 0 };
+            SinkLayout adhoc;
+
+            adhoc.fmt = fmt;
+            adhoc.output = OUTPUT_TEXT;
+            compileFormat(fmt, adhoc.program);
 
-            while ((c = readChar(fmt, length, i)) != '\0') 
+            emitMessage(record, false, &adhoc, nullptr, [&](RecordBuffer<char>& out) { appendFormatted(out, text, args); });
+        }
+
+        // Renders the record once per distinct layout among the sinks that accept its level and
+        // hands each sink either that text or a copy with the color escapes cut out. When
+        // several layouts are needed the message itself is formatted once up front. An adhoc
+        // layout stands in for every text layout; structured sinks keep their own output.
+        // Nothing is formatted unless a sink takes the record: selection holds the sinks that
+        // did when they were asked before the record was queued, nullptr asks them now.
+        template<typename Message>
+        bool Logger::emitMessage(const Record& record, bool wide, const SinkLayout* adhoc, const SinkSelection* selection, const Message& message)
+        {
+            EpochGuard guard;
+            const SinkTable* table = sinkOwner.load(std::memory_order_acquire)->sinks.load(std::memory_order_seq_cst);
+            uint32_t layouts = 0;
+
+            // A record that waited in the queue while the sinks changed is asked about again.
+            uint32_t selected = selection != nullptr && selection->generation == table->generation ? selection->entries : selectSinks(table, record);
+
+            auto slot = [&](const SinkEntry& entry)
+            {
+                return adhoc != nullptr && table->layouts[entry.layout].output == OUTPUT_TEXT ? 0 : entry.layout;
+            };
+
+            for (size_t i = 0; i < table->count; i++)
+            {
+                if (selected & (1u << i)) layouts |= 1u << slot(table->entries[i]);
+            }
+
+            if (layouts == 0) return false;
+
+            ThreadCounters& counters = ThreadCounters::local();
+            bool timed = counters.timeNext();
+            int64_t start = timed ? ThreadCounters::now() : 0;
+            int64_t writeTime = 0;
+
+            bool shared = (layouts & (layouts - 1)) != 0;
+            if (shared)
+            {
+                sharedMessage.clear();
+                message(sharedMessage);
+            }
+
+            auto text = [&](RecordBuffer<char>& out)
+            {
+                if (shared) out.append(sharedMessage.data(), sharedMessage.size());
+                else message(out);
+            };
+
+            for (uint32_t index = 0; layouts != 0; index++)
             {
-                switch (c) 
+                if ((layouts & (1u << index)) == 0) continue;
+                layouts &= ~(1u << index);
+
+                bool colored = false;
+                bool plain = false;
+
+                for (size_t i = 0; i < table->count; i++)
                 {
-                    case '%':
-                    {
-                        i++;
-                        c = readChar(fmt, length, i);
-                        switch (c)
-                        {
-                            case '0':
-                                printColor(FORMAT_COLOR_BLACK);
-                                break;
-                            case '1':
-                                printColor(FORMAT_COLOR_RED);
-                                break;
-                            case '2':
-                                printColor(FORMAT_COLOR_GREEN);
-                                break;
-                            case '3':
-                                printColor(FORMAT_COLOR_YELLOW);
-                                break;
-                            case '4':
-                                printColor(FORMAT_COLOR_BLUE);
-                                break;
-                            case '5':
-                                printColor(FORMAT_COLOR_MAGENTA);
-                                break;
-                            case '6':
-                                printColor(FORMAT_COLOR_CYAN);
-                                break;
-                            case '7':
-                                printColor(FORMAT_COLOR_WHITE);
-                                break;
-                            case '8':
-                                printColor(FORMAT_COLOR_RESET);
-                                break;
-                            case 't':
-                            {
-                                getCurrentTime(currentTime);
-                                printf("%s", currentTime);
-                                break;
-                            }
-                            case 'd':
-                            {
-                                getCurrentDate(currentDate);
-                                printf("%s", currentDate);
-                                break;
-                            }
-                            case 'l':
-                            {
-                                printLevel();
-                                break;
-                            }
-                            case 'm':
-                            {
-                                printf("utf-8");
-                                break;
-                            }
-                            case 's':
-                            {
-                                va_list args;
-                                va_start(args, text);
-                                vprintf(text, args);
-                                va_end(args);
-                                break;
-                            }
-                        }
-                        i++;
-                        break;
-                    default:
-                        i++;
-                        printf("%c", c);
-                        break;
-                    }
+                    const SinkEntry& entry = table->entries[i];
+                    if ((selected & (1u << i)) == 0 || slot(entry) != index) continue;
+
+                    if (entry.colors) colored = true;
+                    else plain = true;
                 }
+
+                const SinkLayout& layout = adhoc != nullptr && index == 0 ? *adhoc : table->layouts[index];
+                ColorSpans& spans = colorSpans;
+                spans.enabled = colored;
+                spans.count = 0;
+
+                recordBuffer.clear();
+                if (layout.output != OUTPUT_TEXT) renderStructured(record, layout.output, text);
+                else
+                {
+                    if (adhoc == nullptr) printLevelColor(record.level);
+                    if (wide) renderLayout(record, layout.fmtW, layout.programW, text);
+                    else renderLayout(record, layout.fmt, layout.program, text);
+                    if (adhoc == nullptr) clearLevel();
+                }
+
+                if (colored && plain) stripColors(recordBuffer, spans, plainBuffer);
+
+                int64_t writeStart = timed ? ThreadCounters::now() : 0;
+
+                for (size_t i = 0; i < table->count; i++)
+                {
+                    const SinkEntry& entry = table->entries[i];
+                    if ((selected & (1u << i)) == 0 || slot(entry) != index) continue;
+
+                    const RecordBuffer<char>& out = entry.colors || !colored ? recordBuffer : plainBuffer;
+                    entry.sink->write(out.data(), out.size());
+                    counters.countWrite(entry.sink, out.size());
+                }
+
+                if (timed) writeTime += ThreadCounters::now() - writeStart;
             }
+
+            if (timed) counters.addTiming(ThreadCounters::now() - start - writeTime, writeTime);
+            return true;
         }
 
-        void Logger::printFmtArgs(const char* fmt, const char* text, va_list args)
+        // One JSON object or logfmt line per record, with the time in ISO 8601 local time to
+        // the microsecond whatever the logger's precision.
+        template<typename Message>
+        void Logger::renderStructured(const Record& record, OutputFormat output, const Message& message)
         {
-            char c = 0;
-            int i = 0;
-            int currentObj = 0;
-            int length = strlen(fmt);
+            const TimestampCache& cache = cachedTimestamp(record.timestamp);
+            char time[27];
 
-            while ((c = readChar(fmt, length, i)) != '\0') 
+            memcpy(time, cache.date, 10);
+            time[4] = time[7] = '-';
+            time[10] = 'T';
+            memcpy(time + 11, cache.time, 8);
+            time[19] = '.';
+            writeDigits(time + 20, (int)(record.timestamp % 1000000), 6);
+            time[26] = '\0';
+
+            RecordBuffer<char>& text = structuredMessage;
+            text.clear();
+            message(text);
+
+            if (output == OUTPUT_JSON)
             {
-                switch (c) 
+                recordBuffer.append("{\"time\":\"");
+                recordBuffer.append(time, 26);
+                recordBuffer.append("\",\"level\":\"");
+                printLevel(record.level);
+                recordBuffer.append("\"");
+
+                if (name[0] != '\0')
                 {
-                    case '%':
-                    {
-                        i++;
-                        c = readChar(fmt, length, i);
-                        switch (c)
-                        {
-                            case '0':
-                                printColor(FORMAT_COLOR_BLACK);
-                                break;
-                            case '1':
-                                printColor(FORMAT_COLOR_RED);
-                                break;
-                            case '2':
-                                printColor(FORMAT_COLOR_GREEN);
-                                break;
-                            case '3':
-                                printColor(FORMAT_COLOR_YELLOW);
-                                break;
-                            case '4':
-                                printColor(FORMAT_COLOR_BLUE);
-                                break;
-                            case '5':
-                                printColor(FORMAT_COLOR_MAGENTA);
-                                break;
-                            case '6':
-                                printColor(FORMAT_COLOR_CYAN);
-                                break;
-                            case '7':
-                                printColor(FORMAT_COLOR_WHITE);
-                                break;
-                            case '8':
-                                printColor(FORMAT_COLOR_RESET);
-                                break;
-                            case 't':
-                            {
-                                getCurrentTime(currentTime);
-                                printf("%s", currentTime);
-                                break;
-                            }
-                            case 'd':
-                            {
-                                getCurrentDate(currentDate);
-                                printf("%s", currentDate);
-                                break;
-                            }
-                            case 'l':
-                            {
-                                printLevel();
-                                break;
-                            }
-                            case 'm':
-                            {
-                                printf("utf-8");
-                                break;
-                            }
-                            case 's':
-                            {
-                                vprintf(text, args);
-                                break;
-                            }
-                        }
-                        i++;
+                    recordBuffer.append(",\"logger\":\"");
+                    appendJsonString(recordBuffer, name, strlen(name));
+                    recordBuffer.append("\"");
+                }
+
+                recordBuffer.append(",\"msg\":\"");
+                appendJsonString(recordBuffer, text.data(), text.size());
+                recordBuffer.append("\"");
+
+                if (record.sampleRate > 1)
+                {
+                    recordBuffer.append(",\"sample_rate\":");
+                    printSampleRate(record.sampleRate);
+                }
+
+                appendJsonFields(recordBuffer, record.fields, record.fieldsSize);
+                recordBuffer.append("}\n");
+            }
+            else
+            {
+                recordBuffer.append("time=");
+                recordBuffer.append(time, 26);
+                recordBuffer.append(" level=");
+                printLevel(record.level);
+
+                if (name[0] != '\0')
+                {
+                    recordBuffer.append(" logger=");
+                    appendLogfmtValue(recordBuffer, name, strlen(name));
+                }
+
+                recordBuffer.append(" msg=");
+                appendLogfmtValue(recordBuffer, text.data(), text.size());
+
+                if (record.sampleRate > 1)
+                {
+                    recordBuffer.append(" sample_rate=");
+                    printSampleRate(record.sampleRate);
+                }
+
+                appendLogfmtFields(recordBuffer, record.fields, record.fieldsSize);
+                recordBuffer.append("\n");
+            }
+        }
+
+        // Wide layouts share the engine; their literal runs are transcoded as they are copied.
+        template<typename CharT, typename Message>
+        void Logger::renderLayout(const Record& record, const CharT* layout, const FormatProgram& program, const Message& message)
+        {
+            for (size_t i = 0; i < program.count; i++)
+            {
+                const FormatToken& token = program.tokens[i];
+
+                switch (token.type)
+                {
+                    case TOKEN_LITERAL:
+                        appendText(recordBuffer, layout + token.offset, token.length);
                         break;
-                    default:
-                        i++;
-                        printf("%c", c);
+                    case TOKEN_COLOR:
+                        printColorCode(token.offset);
+                        break;
+                    case TOKEN_TIME:
+                        printTime(record.timestamp);
+                        break;
+                    case TOKEN_DATE:
+                        printDate(record.timestamp);
+                        break;
+                    case TOKEN_LEVEL:
+                        printLevel(record.level);
+                        break;
+                    case TOKEN_ENCODING:
+                        recordBuffer.append("utf-8");
+                        break;
+                    case TOKEN_SAMPLE_RATE:
+                        printSampleRate(record.sampleRate);
+                        break;
+                    case TOKEN_MESSAGE:
+                        message(recordBuffer);
+                        appendLogfmtFields(recordBuffer, record.fields, record.fieldsSize);
                         break;
-                    }
                 }
             }
         }
 
         void Logger::logW(const wchar_t* text, va_list args)
         {
-            _setmode(_fileno(stdout), _O_U16TEXT);
-            printLevelColor();
-            printFmtArgsW(fmtW, text, args);
-            clearLevel();
+            logW((WarningLevel)level.load(std::memory_order_relaxed), text, args);
         }
         
         void Logger::logW(WarningLevel _level, const wchar_t* text, va_list args)
         {
-            _setmode(_fileno(stdout), _O_U16TEXT);
-            WarningLevel previousLevel = level;
-            setLevel(_level);
-            printLevelColor();
-            logW(text, args);
-            level = previousLevel;
-            clearLevel();
+            if (!isEnabled(_level)) return;
+
+            submit(_level, true, text, nullptr, 0, [&](RecordBuffer<char>& out) { appendFormatted(out, text, args); });
         }
 
         void Logger::logMsgW(const wchar_t* text, ...) 
         {
-            printLevelColor();
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW((WarningLevel)level.load(std::memory_order_relaxed), text, args);
             va_end(args);
-            clearLevel();
         }
 
         void Logger::logMsgW(WarningLevel _level, const wchar_t* text, ...) 
         {
-            WarningLevel previousLevel = level;
-            setLevel(_level);
-            printLevelColor();
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(_level, text, args);
             va_end(args);
-            level = previousLevel;
-            clearLevel();
         }
         
         void Logger::logTraceW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_TRACE);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_TRACE, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logDebugW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_DEBUG);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_DEBUG, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logInfoW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_INFO);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_INFO, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logWarningW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_WARNING);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_WARNING, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logErrorW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_ERROR);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_ERROR, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::logFatalW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_FATAL);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_FATAL, text, args);
             va_end(args);
-            level = previousLevel;
         }
 
         void Logger::logAssertW(const wchar_t* text, ...)
         {
-            WarningLevel previousLevel = level;
-            setLevel(WarningLevel::LEVEL_ASSERT);
             va_list args;
             va_start(args, text);
-            logW(text, args);
+            logW(WarningLevel::LEVEL_ASSERT, text, args);
             va_end(args);
-            level = previousLevel;
         }
         
         void Logger::printFmtW(const wchar_t* fmt, const wchar_t* text, ...)
         {
-            wchar_t c = 0;
-            int i = 0;
-            int currentObj = 0;
-            size_t length = wcslen(fmt);
+            va_list args;
+            va_start(args, text);
+            printFmtArgsW(fmt, text, args);
+            va_end(args);
+        }
+        
+        void Logger::printFmtArgsW(const wchar_t* fmt, const wchar_t* text, va_list args)
+        {
+            Record record = { (WarningLevel)level.load(std::memory_order_relaxed), currentTimestamp(), 0, nullptr, 0 };
+            SinkLayout adhoc;
+
+            adhoc.fmtW = fmt;
+            adhoc.output = OUTPUT_TEXT;
+            compileFormat(fmt, adhoc.programW);
+
+            emitMessage(record, true, &adhoc, nullptr, [&](RecordBuffer<char>& out) { appendFormatted(out, text, args); });
+        }
+
+        WarningLevel Logger::getThreshold() const
+        {
+            return (WarningLevel)threshold.load(std::memory_order_relaxed);
+        }
 
-            while ((c = readCharW(fmt, length, i)) != L'\0') 
+        // Producers only format the message text into a queue slot; the layout, colors and
+        // stdout I/O happen on the writer thread. stopAsync() must not race with other threads
+        // that are still logging through this logger.
+        void Logger::startAsync(size_t capacity, OverflowPolicy policy)
+        {
+            if (root != this)
             {
-                switch (c) 
+                root->startAsync(capacity, policy);
+                return;
+            }
+
+            if (asyncRunning.load(std::memory_order_acquire)) return;
+
+            asyncQueue = new RingBuffer<AsyncRecord>(capacity);
+            asyncCapacity = asyncQueue->capacity();
+            overflowPolicy = policy;
+            asyncRunning.store(true, std::memory_order_release);
+            asyncThread = std::thread(&Logger::asyncWriter, this);
+        }
+
+        void Logger::stopAsync()
+        {
+            if (root != this)
+            {
+                root->stopAsync();
+                return;
+            }
+
+            if (!asyncRunning.exchange(false)) return;
+
+            {
+                std::lock_guard<std::mutex> lock(writerMutex);
+                writerWakeup.notify_one();
+            }
+
+            asyncThread.join();
+            delete asyncQueue;
+            asyncQueue = nullptr;
+        }
+
+        void Logger::flush()
+        {
+            if (root != this) root->flush();
+            else flushSuppressed();
+
+            if (asyncRunning.load(std::memory_order_acquire))
+            {
+                uint64_t target = pushedRecords.load(std::memory_order_acquire);
+
+                while (retiredRecords.load(std::memory_order_acquire) < target)
                 {
-                    case L'%':
-                    {
-                        i++;
-                        c = readCharW(fmt, length, i);
-                        switch (c)
-                        {
-                            case L'0':
-                                printColor(FORMAT_COLOR_BLACK);
-                                break;
-                            case L'1':
-                                printColor(FORMAT_COLOR_RED);
-                                break;
-                            case L'2':
-                                printColor(FORMAT_COLOR_GREEN);
-                                break;
-                            case L'3':
-                                printColor(FORMAT_COLOR_YELLOW);
-                                break;
-                            case L'4':
-                                printColor(FORMAT_COLOR_BLUE);
-                                break;
-                            case L'5':
-                                printColor(FORMAT_COLOR_MAGENTA);
-                                break;
-                            case L'6':
-                                printColor(FORMAT_COLOR_CYAN);
-                                break;
-                            case L'7':
-                                printColor(FORMAT_COLOR_WHITE);
-                                break;
-                            case L'8':
-                                printColor(FORMAT_COLOR_RESET);
-                                break;
-                            case L't':
-                            {
-                                getCurrentTimeW(currentTimeW);
-                                wprintf(L"%ls", currentTimeW);
-                                break;
-                            }
-                            case L'd':
-                            {
-                                getCurrentDateW(currentDateW);
-                                wprintf(L"%ls", currentDateW);
-                                break;
-                            }
-                            case L'l':
-                            {
-                                printLevelW();
-                                break;
-                            }
-                            case L'm':
-                            {
-                                wprintf(L"utf-16");
-                            }
-                            case L's':
-                            {
-                                va_list args;
-                                va_start(args, text);
-                                vwprintf(text, args);
-                                va_end(args);
-                                break;
-                            }
-                        }
-                        i++;
-                        break;
-                    default:
-                        i++;
-                        wprintf(L"%lc", c);
-                        break;
-                    }
+                    wakeWriter();
+                    std::this_thread::yield();
                 }
             }
+
+            flushSinks();
         }
-        
-        void Logger::printFmtArgsW(const wchar_t* fmt, const wchar_t* text, va_list args)
+
+        bool Logger::isAsync() const
+        {
+            return root->asyncRunning.load(std::memory_order_acquire);
+        }
+
+        uint64_t Logger::droppedRecords() const
+        {
+            return root->dropped.load(std::memory_order_relaxed);
+        }
+
+        template<typename Render>
+        bool Logger::pushAsync(Logger* origin, const Record& header, const SinkSelection& selection, bool wide, const Render& render)
         {
-            wchar_t c = 0;
-            int i = 0;
-            int currentObj = 0;
-            size_t length = wcslen(fmt);
+            RecordBuffer<char>& message = messageBuffer;
 
-            while ((c = readCharW(fmt, length, i)) != L'\0') 
+            message.clear();
+            render(message);
+
+            // The slot holds the message, a NUL and the packed fields. Records that do not fit
+            // go into a heap block the writer frees; arena blocks cannot be used, they belong
+            // to the producing thread.
+            size_t length = message.size();
+            size_t fieldsSize = header.fieldsSize;
+            char* spill = nullptr;
+
+            if (length + 1 + fieldsSize > ASYNC_TEXT_LENGTH)
             {
-                switch (c) 
+                spill = (char*)malloc(length + 1 + fieldsSize);
+
+                if (spill != nullptr)
                 {
-                    case L'%':
+                    memcpy(spill, message.data(), length);
+                    spill[length] = '\0';
+                    memcpy(spill + length + 1, header.fields, fieldsSize);
+                }
+                else
+                {
+                    // Out of memory: fields are kept whole and may take the space the message
+                    // does not need, but no more than half of it from a long message, which is
+                    // cut on a UTF-8 sequence boundary.
+                    size_t reserved = length < ASYNC_TEXT_LENGTH / 2 ? length : ASYNC_TEXT_LENGTH / 2;
+                    fieldsSize = packedPrefix(header.fields, header.fieldsSize, ASYNC_TEXT_LENGTH - 1 - reserved);
+
+                    if (length > ASYNC_TEXT_LENGTH - 1 - fieldsSize)
                     {
-                        i++;
-                        c = readCharW(fmt, length, i);
-                        switch (c)
+                        length = ASYNC_TEXT_LENGTH - 1 - fieldsSize;
+                        while (length > 0 && (message.data()[length] & 0xC0) == 0x80) length--;
+                    }
+
+                    ThreadCounters::local().countTruncated();
+                }
+            }
+
+            auto fill = [&](AsyncRecord& record)
+            {
+                record.origin = origin;
+                record.level = header.level;
+                record.timestamp = header.timestamp;
+                record.sampleRate = header.sampleRate;
+                record.selection = selection;
+                record.wide = wide;
+                record.fieldsOffset = (uint32_t)(length + 1);
+                record.fieldsSize = (uint32_t)fieldsSize;
+                record.spill = spill;
+                if (spill != nullptr) return;
+
+                memcpy(record.text, message.data(), length);
+                record.text[length] = '\0';
+                memcpy(record.text + length + 1, header.fields, fieldsSize);
+            };
+
+            for (;;)
+            {
+                if (asyncQueue->tryPush(fill))
+                {
+                    pushedRecords.fetch_add(1, std::memory_order_release);
+                    wakeWriter();
+                    return true;
+                }
+
+                switch (overflowPolicy)
+                {
+                    case OVERFLOW_DROP_NEWEST:
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                        ThreadCounters::local().countDropped(header.level);
+                        free(spill);
+                        return false;
+                    case OVERFLOW_DROP_OLDEST:
+                        if (asyncQueue->tryPop([](AsyncRecord& oldest) { ThreadCounters::local().countDropped(oldest.level); free(oldest.spill); }))
                         {
-                            case L'0':
-                                printColor(FORMAT_COLOR_BLACK);
-                                break;
-                            case L'1':
-                                printColor(FORMAT_COLOR_RED);
-                                break;
-                            case L'2':
-                                printColor(FORMAT_COLOR_GREEN);
-                                break;
-                            case L'3':
-                                printColor(FORMAT_COLOR_YELLOW);
-                                break;
-                            case L'4':
-                                printColor(FORMAT_COLOR_BLUE);
-                                break;
-                            case L'5':
-                                printColor(FORMAT_COLOR_MAGENTA);
-                                break;
-                            case L'6':
-                                printColor(FORMAT_COLOR_CYAN);
-                                break;
-                            case L'7':
-                                printColor(FORMAT_COLOR_WHITE);
-                                break;
-                            case L'8':
-                                printColor(FORMAT_COLOR_RESET);
-                                break;
-                            case L't':
-                            {
-                                getCurrentTimeW(currentTimeW);
-                                wprintf(L"%ls", currentTimeW);
-                                break;
-                            }
-                            case L'd':
-                            {
-                                getCurrentDateW(currentDateW);
-                                wprintf(L"%ls", currentDateW);
-                                break;
-                            }
-                            case L'l':
-                            {
-                                printLevelW();
-                                break;
-                            }
-                            case L'm':
-                            {
-                                wprintf(L"utf-16");
-                                break;
-                            }
-                            case L's':
-                            {
-                                vwprintf(text, args);
-                                break;
-                            }
+                            dropped.fetch_add(1, std::memory_order_relaxed);
+                            retiredRecords.fetch_add(1, std::memory_order_release);
                         }
-                        i++;
                         break;
-                    default:
-                        i++;
-                        wprintf(L"%lc", c);
+                    case OVERFLOW_BLOCK:
+                        wakeWriter();
+                        std::this_thread::yield();
                         break;
-                    }
                 }
             }
         }
 
-        Logger* Logger::get() 
+        void Logger::wakeWriter()
         {
-            return &Logger::logger;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!writerSleeping.load(std::memory_order_relaxed)) return;
+
+            std::lock_guard<std::mutex> lock(writerMutex);
+            writerWakeup.notify_one();
         }
-        
-        void Logger::printLevel()
+
+        void Logger::asyncWriter()
+        {
+            int idle = 0;
+
+            for (;;)
+            {
+                // Once the crash path has set crashing it owns the queue; it waits for the
+                // writer to leave a record it is busy with.
+                writerBusy.store(true, std::memory_order_seq_cst);
+                if (Sink::crashing.load(std::memory_order_seq_cst))
+                {
+                    writerBusy.store(false, std::memory_order_release);
+                    if (!asyncRunning.load(std::memory_order_acquire)) break;
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+
+                bool popped = asyncQueue->tryPop([this](AsyncRecord& record) { writeRecord(record); });
+                if (!popped && asyncRunning.load(std::memory_order_acquire) && idle == 0) flushSinks();
+                writerBusy.store(false, std::memory_order_release);
+
+                if (popped)
+                {
+                    // The depth seen by the only thread that takes records out is the one that
+                    // matters for back-pressure; producers skip the bookkeeping.
+                    uint64_t retired = retiredRecords.fetch_add(1, std::memory_order_release) + 1;
+                    int64_t depth = (int64_t)(pushedRecords.load(std::memory_order_relaxed) - retired) + 1;
+                    if (depth > (int64_t)queueHighWater.load(std::memory_order_relaxed)) queueHighWater.store((uint64_t)depth, std::memory_order_relaxed);
+
+                    idle = 0;
+                    continue;
+                }
+
+                if (!asyncRunning.load(std::memory_order_acquire)) break;
+
+                if (++idle < 64)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(writerMutex);
+                writerSleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                writerWakeup.wait(lock, [this]() { return !asyncQueue->empty() || !asyncRunning.load(std::memory_order_acquire); });
+                writerSleeping.store(false, std::memory_order_relaxed);
+                idle = 0;
+            }
+
+            flushSinks();
+        }
+
+        void Logger::writeRecord(const AsyncRecord& record)
+        {
+            const char* text = record.data();
+            Record header = { record.level, record.timestamp, record.sampleRate, text + record.fieldsOffset, record.fieldsSize };
+            bool written = record.origin->emitMessage(header, record.wide, nullptr, &record.selection, [&](RecordBuffer<char>& out) { out.append(text, record.fieldsOffset - 1); });
+            free(record.spill);
+
+            if (written) ThreadCounters::local().countEmitted(record.level);
+            else ThreadCounters::local().countDeclined();
+        }
+
+        void Logger::printLevel(WarningLevel _level)
         {
-            switch (level) 
+            switch (_level) 
             {
                 case LEVEL_TRACE:
-                    printf("TRACE");
+                    recordBuffer.append("TRACE");
                     break;
                 case LEVEL_DEBUG:
-                    printf("DEBUG");
+                    recordBuffer.append("DEBUG");
                     break;
                 case LEVEL_INFO:
-                    printf("INFO");
+                    recordBuffer.append("INFO");
                     break;
                 case LEVEL_WARNING:
-                    printf("WARNING");
+                    recordBuffer.append("WARNING");
                     break;
                 case LEVEL_ERROR:
-                    printf("ERROR");
+                    recordBuffer.append("ERROR");
                     break;
                 case LEVEL_FATAL:
-                    printf("FATAL");
+                    recordBuffer.append("FATAL");
                     break;
                 case LEVEL_ASSERT:
-                    printf("ASSERT");
+                    recordBuffer.append("ASSERT");
                     break;
             }
         }
 
-        void Logger::printLevelColor()
+        void Logger::printLevelColor(WarningLevel _level)
         {
-            switch (level) 
+            switch (_level) 
             {
                 case LEVEL_TRACE:
                 case LEVEL_DEBUG:
@@ -703,128 +1129,345 @@ namespace AK
             }
         }
 
-        #if defined(PLATFORM_WINDOWS)
+        void Logger::printColor(const char* color) 
+        {
+            ColorSpans& spans = colorSpans;
+            if (!spans.enabled) return;
+
+            size_t length = strlen(color);
+            spans.offsets[spans.count] = (uint32_t)recordBuffer.size();
+            spans.lengths[spans.count] = (uint32_t)length;
+            spans.count++;
 
-        void Logger::printColor(int color) 
+            recordBuffer.append(color, length);
+        }
+
+        static bool resolveColors(Sink* _sink, ColorMode colors)
         {
-            SetConsoleTextAttribute(handle, color);
+            return colors == COLOR_ALWAYS || (colors == COLOR_AUTO && _sink->supportsColor());
         }
 
-        #else
+        // Tags every published table, so records queued against an older one can tell.
+        static std::atomic<uint64_t> sinkGenerations(1);
 
-        void Logger::printColor(const char* color) 
+        void Logger::initSinks()
+        {
+            SinkTable* table = new SinkTable();
+
+            table->entries[0].sink = &consoleSink;
+            table->entries[0].threshold = LEVEL_TRACE;
+            table->entries[0].colors = true;
+            table->entries[0].layout = 0;
+            table->count = 1;
+
+            table->layouts[0].fmt = fmt.load();
+            table->layouts[0].fmtW = fmtW.load();
+            compileFormat(table->layouts[0].fmt, table->layouts[0].program);
+            compileFormat(table->layouts[0].fmtW, table->layouts[0].programW);
+            table->layoutCount = 1;
+
+            table->lowest = LEVEL_TRACE;
+            table->generation = sinkGenerations.fetch_add(1, std::memory_order_relaxed);
+            sinks.store(table, std::memory_order_release);
+        }
+
+        // Changes are made on a copy under sinkMutex and published whole.
+        Logger::SinkTable* Logger::copySinks()
         {
-            printf("%s", color);
+            return new SinkTable(*sinks.load(std::memory_order_relaxed));
         }
 
-        #endif
+        // Drops the layouts no entry uses any more and recomputes the lowest threshold. Sinks
+        // leaving the table are flushed first, so what they buffered is not written after
+        // records that go to the sinks replacing them.
+        void Logger::publishSinks(SinkTable* table)
+        {
+            const SinkTable* current = sinks.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < current->count; i++)
+            {
+                bool kept = false;
+                for (size_t j = 0; j < table->count; j++) kept |= table->entries[j].sink == current->entries[i].sink;
+                if (!kept) current->entries[i].sink->flush();
+            }
 
-        void Logger::clearLevel()
+            uint32_t remap[MAX_SINKS];
+            size_t used = 0;
+
+            for (size_t i = 0; i < table->layoutCount; i++)
+            {
+                bool referenced = false;
+                for (size_t j = 0; j < table->count; j++) referenced |= table->entries[j].layout == i;
+                if (!referenced) continue;
+
+                if (used != i) table->layouts[used] = table->layouts[i];
+                remap[i] = (uint32_t)used++;
+            }
+
+            table->layoutCount = used;
+            table->lowest = LEVEL_ASSERT;
+
+            for (size_t i = 0; i < table->count; i++)
+            {
+                table->entries[i].layout = remap[table->entries[i].layout];
+                if (table->entries[i].threshold < table->lowest) table->lowest = table->entries[i].threshold;
+            }
+
+            table->generation = sinkGenerations.fetch_add(1, std::memory_order_relaxed);
+            const SinkTable* replaced = sinks.exchange(table, std::memory_order_seq_cst);
+            retire((void*)replaced, &Logger::destroySinks);
+        }
+
+        // The entries a record goes to: those whose threshold it passes and whose sink accepts
+        // it, asked in table order.
+        uint32_t Logger::selectSinks(const SinkTable* table, const Record& record)
         {
-            printColor(FORMAT_COLOR_RESET);
+            uint32_t selected = 0;
+
+            for (size_t i = 0; i < table->count; i++)
+            {
+                const SinkEntry& entry = table->entries[i];
+                if (record.level >= entry.threshold && entry.sink->accept(record)) selected |= 1u << i;
+            }
+
+            return selected;
+        }
+
+        void Logger::destroySinks(void* table)
+        {
+            delete (SinkTable*)table;
         }
 
-        char Logger::readChar(const char* fmt, size_t length, int i)
+        void Logger::flushSinks()
         {
-            if (i >= length) return '\0';
-            return fmt[i];
+            EpochGuard guard;
+            const SinkTable* table = sinkOwner.load(std::memory_order_acquire)->sinks.load(std::memory_order_seq_cst);
+            for (size_t i = 0; i < table->count; i++) table->entries[i].sink->flush();
         }
 
-        char* Logger::getCurrentTime(char* str)
+        // The sink is not owned; it must outlive every record written while it is set. A
+        // threshold set with setSinkThreshold() stays with the sink it was set for.
+        void Logger::setSink(Sink* _sink)
         {
-            time_t t = time(NULL);
-            struct tm* lt = localtime(&t);
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
 
-            sprintf(str, "%02d:%02d:%02d", lt->tm_hour, lt->tm_min, lt->tm_sec);
-            str[8] = '\0';
-            return str;
+            SinkTable* table = copySinks();
+            Sink* replacement = _sink != nullptr ? _sink : &consoleSink;
+            if (table->entries[0].sink != replacement) table->entries[0].threshold = LEVEL_TRACE;
+
+            table->entries[0].sink = replacement;
+            table->entries[0].colors = resolveColors(table->entries[0].sink, COLOR_AUTO);
+            publishSinks(table);
+        }
+
+        bool Logger::addSink(Sink* _sink, WarningLevel _threshold)
+        {
+            return addSink(_sink, _threshold, nullptr, nullptr, COLOR_AUTO);
         }
 
-        char* Logger::getCurrentDate(char* str)
+        bool Logger::addSink(Sink* _sink, WarningLevel _threshold, OutputFormat output)
         {
-            time_t t = time(NULL);
-            struct tm* lt = localtime(&t);
+            if (output == OUTPUT_TEXT) return addSink(_sink, _threshold);
+            if (_sink == nullptr) return false;
+
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
+
+            if (sinks.load(std::memory_order_relaxed)->count == MAX_SINKS) return false;
+
+            SinkTable* table = copySinks();
 
-            sprintf(str, "%04d/%02d/%02d", lt->tm_year + 1900, lt->tm_mon + 1, lt->tm_mday);
-            str[10] = '\0';
-            return str;
+            size_t index = 0;
+            while (index < table->layoutCount && table->layouts[index].output != output) index++;
+
+            if (index == table->layoutCount)
+            {
+                SinkLayout& added = table->layouts[table->layoutCount++];
+                added.fmt = "";
+                added.fmtW = L"";
+                added.output = output;
+                added.program.count = 0;
+                added.programW.count = 0;
+            }
+
+            SinkEntry& entry = table->entries[table->count++];
+            entry.sink = _sink;
+            entry.threshold = _threshold;
+            entry.colors = false;
+            entry.layout = (uint32_t)index;
+
+            publishSinks(table);
+            return true;
         }
 
-        void Logger::printLevelW()
+        bool Logger::addSink(Sink* _sink, WarningLevel _threshold, const char* layout, const wchar_t* layoutW, ColorMode colors)
         {
-            switch (level) 
+            if (_sink == nullptr) return false;
+
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
+
+            if (sinks.load(std::memory_order_relaxed)->count == MAX_SINKS) return false;
+
+            SinkTable* table = copySinks();
+            if (layout == nullptr) layout = fmt.load();
+            if (layoutW == nullptr) layoutW = fmtW.load();
+
+            size_t index = 0;
+            while (index < table->layoutCount && (table->layouts[index].output != OUTPUT_TEXT || strcmp(table->layouts[index].fmt, layout) != 0 || wcscmp(table->layouts[index].fmtW, layoutW) != 0)) index++;
+
+            if (index == table->layoutCount)
             {
-                case LEVEL_TRACE:
-                    wprintf(L"TRACE");
-                    break;
-                case LEVEL_DEBUG:
-                    wprintf(L"DEBUG");
-                    break;
-                case LEVEL_INFO:
-                    wprintf(L"INFO");
-                    break;
-                case LEVEL_WARNING:
-                    wprintf(L"WARNING");
-                    break;
-                case LEVEL_ERROR:
-                    wprintf(L"ERROR");
-                    break;
-                case LEVEL_FATAL:
-                    wprintf(L"FATAL");
-                    break;
-                case LEVEL_ASSERT:
-                    wprintf(L"ASSERT");
-                    break;
+                SinkLayout& added = table->layouts[table->layoutCount++];
+                added.fmt = layout;
+                added.fmtW = layoutW;
+                added.output = OUTPUT_TEXT;
+                compileFormat(layout, added.program);
+                compileFormat(layoutW, added.programW);
+            }
+
+            SinkEntry& entry = table->entries[table->count++];
+            entry.sink = _sink;
+            entry.threshold = _threshold;
+            entry.colors = resolveColors(_sink, colors);
+            entry.layout = (uint32_t)index;
+
+            publishSinks(table);
+            return true;
+        }
+
+        // Only removes sinks added with addSink(); the setSink() one is replaced instead.
+        void Logger::removeSink(Sink* _sink)
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
+
+            const SinkTable* current = sinks.load(std::memory_order_relaxed);
+            size_t index = 1;
+            while (index < current->count && current->entries[index].sink != _sink) index++;
+            if (index == current->count) return;
+
+            SinkTable* table = copySinks();
+            for (size_t i = index + 1; i < table->count; i++) table->entries[i - 1] = table->entries[i];
+            table->count--;
+            publishSinks(table);
+        }
+
+        void Logger::setSinkThreshold(Sink* _sink, WarningLevel _threshold)
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
+
+            SinkTable* table = copySinks();
+            for (size_t i = 0; i < table->count; i++)
+            {
+                if (table->entries[i].sink == _sink) table->entries[i].threshold = _threshold;
+            }
+            publishSinks(table);
+        }
+
+        void Logger::setLayout(const char* layout, const wchar_t* layoutW)
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            adoptSinks();
+
+            SinkTable* table = copySinks();
+            SinkLayout& own = table->layouts[0];
+            own.fmt = layout;
+            own.fmtW = layoutW;
+            compileFormat(layout, own.program);
+            compileFormat(layoutW, own.programW);
+
+            fmt.store(layout);
+            fmtW.store(layoutW);
+            publishSinks(table);
+        }
+
+        void Logger::printColorCode(uint32_t code)
+        {
+            switch (code)
+            {
+                case 0: printColor(FORMAT_COLOR_BLACK); break;
+                case 1: printColor(FORMAT_COLOR_RED); break;
+                case 2: printColor(FORMAT_COLOR_GREEN); break;
+                case 3: printColor(FORMAT_COLOR_YELLOW); break;
+                case 4: printColor(FORMAT_COLOR_BLUE); break;
+                case 5: printColor(FORMAT_COLOR_MAGENTA); break;
+                case 6: printColor(FORMAT_COLOR_CYAN); break;
+                case 7: printColor(FORMAT_COLOR_WHITE); break;
+                case 8: printColor(FORMAT_COLOR_RESET); break;
             }
         }
 
-        wchar_t Logger::readCharW(const wchar_t* fmt, size_t length, int i)
+        void Logger::clearLevel()
+        {
+            printColor(FORMAT_COLOR_RESET);
+        }
+
+        void Logger::printTime(int64_t timestamp)
+        {
+            const TimestampCache& cache = cachedTimestamp(timestamp);
+            recordBuffer.append(cache.time, 8);
+            printSubsecond(recordBuffer, timestamp, (TimePrecision)timePrecision.load(std::memory_order_relaxed));
+        }
+
+        void Logger::printDate(int64_t timestamp)
+        {
+            recordBuffer.append(cachedTimestamp(timestamp).date, 10);
+        }
+
+        void Logger::setTimePrecision(TimePrecision precision)
         {
-            if (i >= length) return L'\0';
-            return fmt[i];
+            timePrecision.store(precision, std::memory_order_relaxed);
         }
 
-        wchar_t* Logger::getCurrentTimeW(wchar_t* str)
+        std::atomic<uint32_t> Logger::samplingPolicy[LEVEL_ASSERT + 1];
+
+        void Logger::setSampling(WarningLevel _level, uint32_t rate, SamplingMode mode)
         {
-            time_t t = time(NULL);
-            struct tm* lt = localtime(&t);
+            if (rate <= 1) rate = 0;
+            else if (rate >= SAMPLING_RANDOM_BIT) rate = SAMPLING_RANDOM_BIT - 1;
+            if (rate != 0 && mode == SAMPLING_RANDOM) rate |= SAMPLING_RANDOM_BIT;
 
-            wsprintfW((wchar_t*)str, L"%02d:%02d:%02d", lt->tm_hour, lt->tm_min, lt->tm_sec);
-            str[8] = L'\0';
-            return str;
+            samplingPolicy[_level].store(rate, std::memory_order_relaxed);
         }
 
-        wchar_t* Logger::getCurrentDateW(wchar_t* str)
+        // Unsampled records count as a rate of 1.
+        void Logger::printSampleRate(uint32_t rate)
         {
-            time_t t = time(NULL);
-            struct tm* lt = localtime(&t);
+            char digits[10];
+            size_t count = 0;
+            if (rate == 0) rate = 1;
+
+            while (rate != 0)
+            {
+                digits[sizeof(digits) - ++count] = (char)('0' + rate % 10);
+                rate /= 10;
+            }
 
-            wsprintfW((wchar_t*)str, L"%04d/%02d/%02d", lt->tm_year + 1900, lt->tm_mon + 1, lt->tm_mday);
-            str[10] = L'\0';
-            return str;
+            recordBuffer.append(digits + sizeof(digits) - count, count);
+        }
+
+        // Wall-clock microseconds derived from the monotonic clock and a wall/monotonic pair
+        // sampled once, so records are cheap to stamp and never go backwards.
+        int64_t Logger::currentTimestamp()
+        {
+            using namespace std::chrono;
+
+            static const int64_t wallBase = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+            static const int64_t steadyBase = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+            int64_t steady = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+            return wallBase + (steady - steadyBase);
         }
 
         void Logger::ConvertWs(const char* src, wchar_t* dest) 
         {
-            const size_t cSize = strlen(src);
-            mbstowcs(dest, src, cSize);
+            dest[utf8ToWide(src, strlen(src), dest)] = 0;
         }
 
-        Logger Logger::logger = Logger("[%l %d %t]: %s\n", L"[%l %d %t]: %s\n", AK::Log::LEVEL_TRACE);
+        Logger Logger::logger("[%l %d %t]: %s\n", L"[%l %d %t]: %s\n", AK::Log::LEVEL_TRACE);
 
-        #if defined(PLATFORM_WINDOWS) 
-        int Logger::FORMAT_COLOR_BLACK =    0x0;
-        int Logger::FORMAT_COLOR_BLUE =     0x1;
-        int Logger::FORMAT_COLOR_GREEN =    0x2;
-        int Logger::FORMAT_COLOR_CYAN =     0x3;
-        int Logger::FORMAT_COLOR_RED =      0x4;
-        int Logger::FORMAT_COLOR_MAGENTA =  0x5;
-        int Logger::FORMAT_COLOR_YELLOW =   0x6;
-        int Logger::FORMAT_COLOR_WHITE =    0x7;
-        int Logger::FORMAT_COLOR_RESET =    -1;
-        
-        #else
-        
         const char* Logger::FORMAT_COLOR_BLACK =    "\x1B[30m";
         const char* Logger::FORMAT_COLOR_RED =      "\x1B[31m";
         const char* Logger::FORMAT_COLOR_GREEN =    "\x1B[32m";
@@ -834,6 +1477,5 @@ namespace AK
         const char* Logger::FORMAT_COLOR_CYAN =     "\x1B[36m";
         const char* Logger::FORMAT_COLOR_WHITE =    "\x1B[37m";
         const char* Logger::FORMAT_COLOR_RESET =    "\x1B[0m";
-        #endif
     }
 }
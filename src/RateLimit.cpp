@@ -0,0 +1,116 @@
+#include "AKL/log.hpp"
+
+namespace AK
+{
+    namespace Log
+    {
+        // One rate-limited call site. The key and the bucket are read by every call through the
+        // site, the suppression counter is written by every dropped one, so they sit on
+        // separate cache lines.
+        struct RateSite
+        {
+            alignas(64) std::atomic<const void*> format;
+            std::atomic<Logger*> origin;
+            std::atomic<int> level;
+            std::atomic<bool> wide;
+            std::atomic<int64_t> nextAllowed;
+
+            alignas(64) std::atomic<uint64_t> suppressed;
+        };
+
+        // Open-addressing table of sites, claimed with a compare-exchange on the key and never
+        // cleared. Sites that find no free slot within MAX_PROBES are not limited.
+        static const size_t SITE_COUNT = 1024;
+        static const size_t MAX_PROBES = 16;
+
+        static RateSite rateSites[SITE_COUNT];
+        static std::atomic<int64_t> rateTolerance(0);
+
+        std::atomic<int64_t> Logger::rateInterval(0);
+
+        static RateSite* findSite(Logger* origin, WarningLevel _level, const void* format, bool wide)
+        {
+            size_t start = (size_t)(((uint64_t)(uintptr_t)format * 0x9E3779B97F4A7C15ull) >> 54);
+
+            for (size_t probe = 0; probe < MAX_PROBES; probe++)
+            {
+                RateSite& site = rateSites[(start + probe) & (SITE_COUNT - 1)];
+                const void* key = site.format.load(std::memory_order_acquire);
+
+                if (key == format) return &site;
+                if (key != nullptr) continue;
+
+                if (site.format.compare_exchange_strong(key, format, std::memory_order_acq_rel))
+                {
+                    site.level.store(_level, std::memory_order_relaxed);
+                    site.wide.store(wide, std::memory_order_relaxed);
+                    site.origin.store(origin, std::memory_order_release);
+                    return &site;
+                }
+
+                if (key == format) return &site;
+            }
+
+            return nullptr;
+        }
+
+        void Logger::setRateLimit(uint32_t perSecond, uint32_t burst)
+        {
+            if (perSecond == 0)
+            {
+                rateInterval.store(0, std::memory_order_relaxed);
+                return;
+            }
+
+            int64_t interval = 1000000 / perSecond;
+            if (interval == 0) interval = 1;
+
+            rateTolerance.store(interval * (burst > 1 ? burst - 1 : 0), std::memory_order_relaxed);
+            rateInterval.store(interval, std::memory_order_relaxed);
+        }
+
+        // A token bucket kept as the time the site's next record is due (GCRA): a record is
+        // let through while it is at most rateTolerance early, which allows bursts of burst
+        // records, and pushes the due time one interval further. One compare-exchange per
+        // accepted record and one increment per dropped one.
+        bool Logger::admitSite(WarningLevel _level, const void* format, bool wide, uint64_t& repeats)
+        {
+            RateSite* site = findSite(this, _level, format, wide);
+            if (site == nullptr) return true;
+
+            int64_t interval = rateInterval.load(std::memory_order_relaxed);
+            int64_t tolerance = rateTolerance.load(std::memory_order_relaxed);
+            int64_t now = currentTimestamp();
+            int64_t next = site->nextAllowed.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (next - tolerance > now)
+                {
+                    site->suppressed.fetch_add(1, std::memory_order_relaxed);
+                    ThreadCounters::local().countSuppressed();
+                    return false;
+                }
+            }
+            while (!site->nextAllowed.compare_exchange_weak(next, (next > now ? next : now) + interval, std::memory_order_relaxed));
+
+            repeats = site->suppressed.load(std::memory_order_relaxed) != 0 ? site->suppressed.exchange(0, std::memory_order_relaxed) : 0;
+            return true;
+        }
+
+        void Logger::flushSuppressed()
+        {
+            for (size_t i = 0; i < SITE_COUNT; i++)
+            {
+                RateSite& site = rateSites[i];
+                if (site.suppressed.load(std::memory_order_relaxed) == 0) continue;
+
+                Logger* origin = site.origin.load(std::memory_order_acquire);
+                if (origin == nullptr) continue;
+
+                uint64_t repeats = site.suppressed.exchange(0, std::memory_order_relaxed);
+                if (repeats != 0) origin->reportRepeats((WarningLevel)site.level.load(std::memory_order_relaxed), site.format.load(std::memory_order_relaxed), site.wide.load(std::memory_order_relaxed), repeats);
+            }
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#include "AKL/log.hpp"
+#include <string.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        // Open-addressing table of named loggers. Slots are only ever filled, never cleared, so
+        // lookups probe without a lock; creation and configuration changes serialize on
+        // registryMutex. At most half the slots are used to keep probe chains short.
+        static const size_t REGISTRY_SIZE = 1024;
+        static const size_t MAX_NAME_LENGTH = 256;
+
+        static std::atomic<Logger*> registrySlots[REGISTRY_SIZE];
+        static Logger* registryOrder[REGISTRY_SIZE / 2];
+        static std::atomic<size_t> registryCount(0);
+        static std::mutex registryMutex;
+
+        static uint32_t hashName(const char* name, size_t length)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+            return hash;
+        }
+
+        static Logger* findLogger(const char* name, size_t length, uint32_t hash)
+        {
+            for (size_t i = hash & (REGISTRY_SIZE - 1);; i = (i + 1) & (REGISTRY_SIZE - 1))
+            {
+                Logger* found = registrySlots[i].load(std::memory_order_acquire);
+                if (found == nullptr) return nullptr;
+
+                const char* foundName = found->getName();
+                if (strncmp(foundName, name, length) == 0 && foundName[length] == '\0') return found;
+            }
+        }
+
+        Logger* Logger::get(const char* _name)
+        {
+            if (_name == nullptr || _name[0] == '\0') return &logger;
+
+            size_t length = strlen(_name);
+            if (length >= MAX_NAME_LENGTH) length = MAX_NAME_LENGTH - 1;
+
+            uint32_t hash = hashName(_name, length);
+            Logger* found = findLogger(_name, length, hash);
+            if (found != nullptr) return found;
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            return create(_name, length, hash);
+        }
+
+        // Creates the logger and any missing ancestors; registryMutex is held. Returns the
+        // nearest existing ancestor once the registry is full.
+        Logger* Logger::create(const char* _name, size_t length, uint32_t _hash)
+        {
+            Logger* found = findLogger(_name, length, _hash);
+            if (found != nullptr) return found;
+
+            size_t parentLength = length;
+            while (parentLength > 0 && _name[parentLength - 1] != '.') parentLength--;
+
+            Logger* _parent = &logger;
+            if (parentLength > 1) _parent = create(_name, parentLength - 1, hashName(_name, parentLength - 1));
+
+            size_t count = registryCount.load(std::memory_order_relaxed);
+            if (count == REGISTRY_SIZE / 2) return _parent;
+
+            char* copy = new char[length + 1];
+            memcpy(copy, _name, length);
+            copy[length] = '\0';
+
+            Logger* created = new Logger(_parent, copy, _hash);
+            registryOrder[count] = created;
+            registryCount.store(count + 1, std::memory_order_release);
+
+            size_t i = _hash & (REGISTRY_SIZE - 1);
+            while (registrySlots[i].load(std::memory_order_relaxed) != nullptr) i = (i + 1) & (REGISTRY_SIZE - 1);
+            registrySlots[i].store(created, std::memory_order_release);
+
+            return created;
+        }
+
+        // Republishes every named logger's effective threshold and sink owner. Parents are
+        // registered before their children, so one pass in creation order sees each parent
+        // already updated. registryMutex is held.
+        void Logger::refreshHierarchy()
+        {
+            size_t count = registryCount.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; i++)
+            {
+                Logger* current = registryOrder[i];
+
+                int effective = current->configuredThreshold >= 0 ? current->configuredThreshold : current->parent->threshold.load(std::memory_order_relaxed);
+                current->threshold.store(effective, std::memory_order_relaxed);
+
+                Logger* owner = current->ownsSinks ? current : current->parent->sinkOwner.load(std::memory_order_relaxed);
+                current->sinkOwner.store(owner, std::memory_order_release);
+            }
+        }
+
+        // Lock-free, for the crash path: the named loggers in creation order, nullptr past the end.
+        Logger* Logger::registered(size_t index)
+        {
+            return index < registryCount.load(std::memory_order_acquire) ? registryOrder[index] : nullptr;
+        }
+
+        void Logger::setThreshold(WarningLevel _level)
+        {
+            if (!inHierarchy())
+            {
+                threshold.store(_level, std::memory_order_relaxed);
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            configuredThreshold = _level;
+            threshold.store(_level, std::memory_order_relaxed);
+            refreshHierarchy();
+        }
+
+        // Drops a named logger's own threshold so it follows its parent again.
+        void Logger::inheritThreshold()
+        {
+            if (parent == nullptr) return;
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            configuredThreshold = -1;
+            refreshHierarchy();
+        }
+
+        // Before a named logger's first sink change, it takes a copy of the sinks it has been
+        // writing to so far; its descendants follow it from then on. sinkMutex is held.
+        void Logger::adoptSinks()
+        {
+            if (ownsSinks) return;
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+
+            SinkTable* table;
+            {
+                EpochGuard guard;
+                table = new SinkTable(*sinkOwner.load(std::memory_order_relaxed)->sinks.load(std::memory_order_seq_cst));
+            }
+
+            const SinkTable* replaced = sinks.exchange(table, std::memory_order_seq_cst);
+            retire((void*)replaced, &Logger::destroySinks);
+
+            ownsSinks = true;
+            refreshHierarchy();
+        }
+    }
+}
@@ -0,0 +1,683 @@
+#include "AKL/log.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <chrono>
+
+#if defined(PLATFORM_WINDOWS)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+namespace AK
+{
+    namespace Log
+    {
+        #if defined(PLATFORM_WINDOWS)
+
+        static void writeAll(int fd, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                int written = _write(fd, data, (unsigned int)size);
+                if (written <= 0) return;
+                data += written;
+                size -= written;
+            }
+        }
+
+        static void writeVector(int fd, const char* first, size_t firstSize, const char* second, size_t secondSize)
+        {
+            writeAll(fd, first, firstSize);
+            writeAll(fd, second, secondSize);
+        }
+
+        static int openAppend(const char* path)
+        {
+            return _open(path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+        }
+
+        static void closeFile(int fd)
+        {
+            _close(fd);
+        }
+
+        static int stdoutFile()
+        {
+            return _fileno(stdout);
+        }
+
+        #else
+
+        static void writeAll(int fd, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return;
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+        // Both pieces in one writev call, picking up after partial writes. The sinks write in
+        // append mode or to streams without an offset, so there is nothing for pwritev2 to add.
+        static void writeVector(int fd, const char* first, size_t firstSize, const char* second, size_t secondSize)
+        {
+            struct iovec parts[2] = { { (void*)first, firstSize }, { (void*)second, secondSize } };
+            struct iovec* next = parts;
+            int count = 2;
+
+            while (count > 0)
+            {
+                if (next->iov_len == 0)
+                {
+                    next++;
+                    count--;
+                    continue;
+                }
+
+                ssize_t written = ::writev(fd, next, count);
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return;
+                }
+
+                while (count > 0 && (size_t)written >= next->iov_len)
+                {
+                    written -= (ssize_t)next->iov_len;
+                    next++;
+                    count--;
+                }
+
+                if (count > 0)
+                {
+                    next->iov_base = (char*)next->iov_base + written;
+                    next->iov_len -= (size_t)written;
+                }
+            }
+        }
+
+        static int openAppend(const char* path)
+        {
+            return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+
+        // Truncating to the length the file has now hands back the blocks preallocated past
+        // its end. That is not the size the sink counted: records still buffered or lost to a
+        // failed write are in the count, while records other processes appended are not.
+        static void closeFile(int fd)
+        {
+            #if defined(__linux__)
+            struct stat info;
+            if (fstat(fd, &info) == 0 && ftruncate(fd, info.st_size) != 0) {}
+            #endif
+            close(fd);
+        }
+
+        static int stdoutFile()
+        {
+            return STDOUT_FILENO;
+        }
+
+        #endif
+
+        static uint64_t fileLength(int fd)
+        {
+            struct stat info;
+            if (fstat(fd, &info) != 0) return 0;
+            return (uint64_t)info.st_size;
+        }
+
+        static bool fileExists(const char* path)
+        {
+            struct stat info;
+            return stat(path, &info) == 0;
+        }
+
+        ConsoleSink::ConsoleSink()
+            : options(), batch(nullptr), batched(0), batchedRecords(0), running(false)
+        {
+        }
+
+        ConsoleSink::ConsoleSink(const BatchOptions& _options)
+            : options(_options), batch(new char[_options.maxBytes != 0 ? _options.maxBytes : 1]), batched(0), batchedRecords(0), running(true)
+        {
+            drainThread = std::thread(&ConsoleSink::drain, this);
+        }
+
+        ConsoleSink::~ConsoleSink()
+        {
+            if (batch == nullptr) return;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+                drainWakeup.notify_one();
+            }
+
+            drainThread.join();
+            flushBatch();
+            delete[] batch;
+        }
+
+        void ConsoleSink::write(const char* data, size_t size)
+        {
+            if (batch == nullptr || crashing.load(std::memory_order_relaxed))
+            {
+                writeAll(stdoutFile(), data, size);
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // The batch and the record that does not fit go out in one call.
+            if (batched + size > options.maxBytes)
+            {
+                writeVector(stdoutFile(), batch, batched, data, size);
+                batched = 0;
+                batchedRecords = 0;
+                return;
+            }
+
+            memcpy(batch + batched, data, size);
+            batched += size;
+
+            if (++batchedRecords == options.maxRecords) flushBatch();
+            else if (batchedRecords == 1) drainWakeup.notify_one();
+        }
+
+        void ConsoleSink::flush()
+        {
+            if (batch != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                flushBatch();
+            }
+
+            fflush(stdout);
+        }
+
+        void ConsoleSink::flushBatch()
+        {
+            if (batched == 0 || crashing.load(std::memory_order_relaxed)) return;
+
+            writeAll(stdoutFile(), batch, batched);
+            batched = 0;
+            batchedRecords = 0;
+        }
+
+        // Sleeps until a batch gets its first record, then writes it out once maxDelayMs have
+        // passed unless a full batch was written before.
+        void ConsoleSink::drain()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (running)
+            {
+                drainWakeup.wait(lock, [this]() { return batchedRecords != 0 || !running; });
+                drainWakeup.wait_for(lock, std::chrono::milliseconds((int64_t)options.maxDelayMs), [this]() { return batchedRecords == 0 || !running; });
+                flushBatch();
+            }
+        }
+
+        void ConsoleSink::emergencyWrite(const char* data, size_t size)
+        {
+            writeAll(stdoutFile(), data, size);
+        }
+
+        // Like FileSink::emergencyFlush(), without the lock.
+        void ConsoleSink::emergencyFlush()
+        {
+            size_t pending = batched;
+            if (batch == nullptr || pending == 0) return;
+
+            writeAll(stdoutFile(), batch, pending);
+            batched = 0;
+        }
+
+        FileSink::FileSink(const char* path)
+            : FileSink(path, 0, 0, 0)
+        {
+        }
+
+        FileSink::FileSink(const char* _path, uint64_t _maxSize, uint32_t _interval, uint32_t _keep)
+            : maxSize(_maxSize), interval(_interval), keep(_keep), fd(-1), buffer(new char[BUFFER_SIZE]), buffered(0), bufferedRecords(0),
+              batchBytes(BUFFER_SIZE), batchRecords(0), batchDelayMs(FLUSH_INTERVAL_MS), fileSize(0), allocated(0), running(true), rotateRequested(false),
+              preallocateRequested(false)
+        {
+            snprintf(path, sizeof(path), "%s", _path);
+
+            fd = openFile();
+            if (fd >= 0) fileSize = allocated = fileLength(fd);
+
+            maintenanceThread = std::thread(&FileSink::maintain, this);
+        }
+
+        FileSink::~FileSink()
+        {
+            {
+                std::lock_guard<std::mutex> lock(maintenanceMutex);
+                running.store(false);
+                maintenanceWakeup.notify_one();
+            }
+
+            maintenanceThread.join();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            flushBuffer();
+            if (fd >= 0) closeFile(fd);
+            delete[] buffer;
+        }
+
+        void FileSink::write(const char* data, size_t size)
+        {
+            bool full;
+            bool low;
+
+            if (crashing.load(std::memory_order_relaxed))
+            {
+                emergencyWrite(data, size);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (fd < 0) return;
+
+                // The buffered records and the one that does not fit go out in one call.
+                if (buffered + size > batchBytes.load(std::memory_order_relaxed))
+                {
+                    writeVector(fd, buffer, buffered, data, size);
+                    buffered = 0;
+                    bufferedRecords = 0;
+                }
+                else
+                {
+                    memcpy(buffer + buffered, data, size);
+                    buffered += size;
+                    if (++bufferedRecords == batchRecords.load(std::memory_order_relaxed)) flushBuffer();
+                }
+
+                fileSize += size;
+                low = fileSize + PREALLOCATE_WATERMARK > allocated;
+                full = maxSize != 0 && fileSize >= maxSize;
+            }
+
+            if (low && !preallocateRequested.exchange(true))
+            {
+                maintenanceWakeup.notify_one();
+            }
+
+            if (full && !rotateRequested.exchange(true))
+            {
+                maintenanceWakeup.notify_one();
+            }
+        }
+
+        void FileSink::flush()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            flushBuffer();
+        }
+
+        // Both skip the buffer lock: the thread holding it may never run again. A write racing
+        // with a crash can at worst be saved twice or cut short.
+        void FileSink::emergencyFlush()
+        {
+            size_t pending = buffered;
+            if (fd < 0 || pending == 0) return;
+
+            writeAll(fd, buffer, pending);
+            buffered = 0;
+        }
+
+        void FileSink::emergencyWrite(const char* data, size_t size)
+        {
+            if (fd >= 0) writeAll(fd, data, size);
+        }
+
+        bool FileSink::isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        void FileSink::setBatching(const BatchOptions& options)
+        {
+            batchBytes.store(options.maxBytes != 0 && options.maxBytes < BUFFER_SIZE ? options.maxBytes : BUFFER_SIZE, std::memory_order_relaxed);
+            batchRecords.store(options.maxRecords, std::memory_order_relaxed);
+            batchDelayMs.store(options.maxDelayMs != 0 ? options.maxDelayMs : FLUSH_INTERVAL_MS, std::memory_order_relaxed);
+        }
+
+        // On POSIX the current file is renamed while it is still open, so logging threads keep
+        // appending to it until the freshly opened file is swapped in under the buffer lock.
+        void FileSink::rotate()
+        {
+            std::lock_guard<std::mutex> rotation(rotateMutex);
+
+            #if defined(PLATFORM_WINDOWS)
+            std::lock_guard<std::mutex> lock(mutex);
+            flushBuffer();
+            if (fd >= 0) closeFile(fd);
+            shiftRotatedFiles();
+            fd = openFile();
+            fileSize = allocated = fd >= 0 ? fileLength(fd) : 0;
+            #else
+            shiftRotatedFiles();
+
+            int newFd = openFile();
+            if (newFd < 0) return;
+
+            int oldFd;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                flushBuffer();
+                oldFd = fd;
+                fd = newFd;
+                fileSize = allocated = fileLength(newFd);
+            }
+
+            if (oldFd >= 0) closeFile(oldFd);
+            #endif
+
+            rotateRequested.store(false);
+        }
+
+        void FileSink::flushBuffer()
+        {
+            if (buffered == 0 || fd < 0 || crashing.load(std::memory_order_relaxed)) return;
+
+            writeAll(fd, buffer, buffered);
+            buffered = 0;
+            bufferedRecords = 0;
+        }
+
+        // Runs without the buffer lock so fallocate() never holds up a logging thread; the
+        // rotation lock keeps the descriptor open meanwhile. A file that cannot be
+        // preallocated is not asked again until it is rotated.
+        void FileSink::preallocate()
+        {
+            std::lock_guard<std::mutex> rotation(rotateMutex);
+            int target;
+            uint64_t start;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (fd < 0 || fileSize + PREALLOCATE_WATERMARK <= allocated) return;
+
+                target = fd;
+                start = allocated > fileSize ? allocated : fileSize;
+            }
+
+            bool failed = false;
+
+            #if defined(__linux__)
+            failed = fallocate(target, FALLOC_FL_KEEP_SIZE, (off_t)start, (off_t)PREALLOCATE_SIZE) != 0;
+            #endif
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd == target) allocated = failed ? UINT64_MAX : start + PREALLOCATE_SIZE;
+        }
+
+        void FileSink::shiftRotatedFiles()
+        {
+            char from[sizeof(path) + 16];
+            char to[sizeof(path) + 16];
+            uint32_t last = keep;
+
+            if (keep == 0)
+            {
+                last = 1;
+                for (;;)
+                {
+                    snprintf(from, sizeof(from), "%s.%u", path, last);
+                    if (!fileExists(from)) break;
+                    last++;
+                }
+            }
+            else
+            {
+                snprintf(from, sizeof(from), "%s.%u", path, keep);
+                remove(from);
+            }
+
+            for (uint32_t i = last - 1; i >= 1; i--)
+            {
+                snprintf(from, sizeof(from), "%s.%u", path, i);
+                snprintf(to, sizeof(to), "%s.%u", path, i + 1);
+                rename(from, to);
+            }
+
+            snprintf(to, sizeof(to), "%s.1", path);
+            rename(path, to);
+        }
+
+        int FileSink::openFile()
+        {
+            return openAppend(path);
+        }
+
+        // Flushes the buffer every FLUSH_INTERVAL_MS, preallocates on request and performs size
+        // and time based rollover, with interval rollovers aligned to multiples of the interval
+        // in wall-clock time.
+        void FileSink::maintain()
+        {
+            time_t nextRollover = interval != 0 ? (time(NULL) / interval + 1) * interval : 0;
+            std::unique_lock<std::mutex> lock(maintenanceMutex);
+
+            while (running.load())
+            {
+                maintenanceWakeup.wait_for(lock, std::chrono::milliseconds((int64_t)batchDelayMs.load(std::memory_order_relaxed)), [this]()
+                {
+                    return rotateRequested.load() || preallocateRequested.load() || !running.load();
+                });
+
+                if (!running.load()) break;
+
+                lock.unlock();
+
+                if (preallocateRequested.exchange(false)) preallocate();
+
+                time_t now = time(NULL);
+                bool due = interval != 0 && now >= nextRollover;
+
+                if (due || rotateRequested.load())
+                {
+                    rotate();
+                    if (due) nextRollover = (now / interval + 1) * interval;
+                }
+                else
+                {
+                    flush();
+                }
+
+                lock.lock();
+            }
+        }
+
+        #if !defined(PLATFORM_WINDOWS)
+
+        // Walks back over the zero-filled tail an interrupted run leaves behind.
+        static uint64_t committedLength(int fd)
+        {
+            char block[4096];
+            uint64_t length = fileLength(fd);
+
+            while (length > 0)
+            {
+                size_t size = length < sizeof(block) ? (size_t)length : sizeof(block);
+                if (pread(fd, block, size, (off_t)(length - size)) != (ssize_t)size) break;
+
+                size_t i = size;
+                while (i > 0 && block[i - 1] == '\0') i--;
+
+                length -= size - i;
+                if (i > 0) break;
+            }
+
+            return length;
+        }
+
+        MappedFileSink::MappedFileSink(const char* path)
+            : MappedFileSink(path, CHUNK_SIZE, MAX_CHUNKS)
+        {
+        }
+
+        MappedFileSink::MappedFileSink(const char* path, uint64_t _chunkSize, uint32_t _maxChunks)
+            : fd(-1), chunkSize(_chunkSize), maxChunks(_maxChunks), chunks(new std::atomic<char*>[_maxChunks]), offset(0), dropped(0)
+        {
+            uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+            chunkSize = (chunkSize + pageSize - 1) / pageSize * pageSize;
+
+            for (uint32_t i = 0; i < maxChunks; i++) chunks[i].store(nullptr, std::memory_order_relaxed);
+
+            fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0) return;
+
+            offset.store(committedLength(fd), std::memory_order_relaxed);
+            chunk(offset.load(std::memory_order_relaxed) / chunkSize);
+        }
+
+        MappedFileSink::~MappedFileSink()
+        {
+            for (uint32_t i = 0; i < maxChunks; i++)
+            {
+                char* mapping = chunks[i].load(std::memory_order_acquire);
+                if (mapping != nullptr) munmap(mapping, chunkSize);
+            }
+
+            if (fd >= 0)
+            {
+                uint64_t length = offset.load(std::memory_order_acquire);
+                uint64_t limit = chunkSize * maxChunks;
+                if (ftruncate(fd, (off_t)(length < limit ? length : limit)) != 0) {}
+                close(fd);
+            }
+
+            delete[] chunks;
+        }
+
+        void MappedFileSink::write(const char* data, size_t size)
+        {
+            if (fd < 0 || size == 0) return;
+
+            uint64_t position = offset.fetch_add(size, std::memory_order_relaxed);
+
+            if (position + size > chunkSize * maxChunks)
+            {
+                dropped.fetch_add(size, std::memory_order_relaxed);
+                return;
+            }
+
+            copy(position, data, size);
+        }
+
+        void MappedFileSink::flush()
+        {
+            for (uint32_t i = 0; i < maxChunks; i++)
+            {
+                char* mapping = chunks[i].load(std::memory_order_acquire);
+                if (mapping != nullptr) msync(mapping, chunkSize, MS_ASYNC);
+            }
+        }
+
+        // Records are already in the shared mapping, so only new ones need saving; they go into
+        // chunks that are mapped already, since mapping another one takes mapMutex.
+        void MappedFileSink::emergencyWrite(const char* data, size_t size)
+        {
+            if (fd < 0 || size == 0) return;
+
+            uint64_t position = offset.fetch_add(size, std::memory_order_relaxed);
+
+            while (size > 0)
+            {
+                uint64_t index = position / chunkSize;
+                uint64_t inChunk = position % chunkSize;
+                size_t part = (size_t)(chunkSize - inChunk < size ? chunkSize - inChunk : size);
+
+                char* mapping = index < maxChunks ? chunks[index].load(std::memory_order_acquire) : nullptr;
+                if (mapping == nullptr) return;
+
+                memcpy(mapping + inChunk, data, part);
+                position += part;
+                data += part;
+                size -= part;
+            }
+        }
+
+        bool MappedFileSink::isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        uint64_t MappedFileSink::droppedBytes() const
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+
+        // A reservation may straddle chunk boundaries; chunks are contiguous in the file, so
+        // the record is simply copied piecewise.
+        void MappedFileSink::copy(uint64_t position, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                uint64_t index = position / chunkSize;
+                uint64_t inChunk = position % chunkSize;
+                size_t part = (size_t)(chunkSize - inChunk < size ? chunkSize - inChunk : size);
+
+                char* mapping = chunk(index);
+                if (mapping == nullptr)
+                {
+                    dropped.fetch_add(size, std::memory_order_relaxed);
+                    return;
+                }
+
+                memcpy(mapping + inChunk, data, part);
+                position += part;
+                data += part;
+                size -= part;
+            }
+        }
+
+        // Chunks are mapped on first use and stay mapped until the sink is destroyed, so a
+        // writer never sees a mapping disappear. The next chunk is mapped along with the
+        // current one to keep the boundary crossing off the common path.
+        char* MappedFileSink::chunk(uint64_t index)
+        {
+            if (index >= maxChunks) return nullptr;
+
+            char* mapping = chunks[index].load(std::memory_order_acquire);
+            if (mapping != nullptr) return mapping;
+
+            std::lock_guard<std::mutex> lock(mapMutex);
+
+            for (uint64_t i = index; i < index + 2 && i < maxChunks; i++)
+            {
+                if (chunks[i].load(std::memory_order_relaxed) != nullptr) continue;
+
+                if (posix_fallocate(fd, (off_t)(i * chunkSize), (off_t)chunkSize) != 0) break;
+
+                void* address = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)(i * chunkSize));
+                if (address == MAP_FAILED) break;
+
+                chunks[i].store((char*)address, std::memory_order_release);
+            }
+
+            return chunks[index].load(std::memory_order_acquire);
+        }
+
+        #endif
+    }
+}
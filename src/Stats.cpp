@@ -0,0 +1,174 @@
+#include "AKL/log.hpp"
+#include <string.h>
+
+namespace AK
+{
+    namespace Log
+    {
+        static std::atomic<ThreadCounters*> counterBlocks(nullptr);
+
+        // Holds the thread's block for as long as the thread runs.
+        class ThreadCountersOwner
+        {
+        public:
+            ThreadCountersOwner() : block(claim()) {}
+            ~ThreadCountersOwner() { block->claimed.store(false, std::memory_order_release); }
+
+            ThreadCounters* block;
+
+        private:
+            static ThreadCounters* claim()
+            {
+                for (ThreadCounters* current = counterBlocks.load(std::memory_order_acquire); current != nullptr; current = current->next)
+                {
+                    bool expected = false;
+                    if (current->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) return current;
+                }
+
+                ThreadCounters* block = new ThreadCounters();
+                block->timingCountdown = ThreadCounters::TIMING_INTERVAL;
+                block->claimed.store(true, std::memory_order_relaxed);
+                block->next = counterBlocks.load(std::memory_order_relaxed);
+                while (!counterBlocks.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed));
+                return block;
+            }
+        };
+
+        ThreadCounters& ThreadCounters::local()
+        {
+            static thread_local ThreadCountersOwner owner;
+            return *owner.block;
+        }
+
+        void ThreadCounters::sum(LoggerStats& stats)
+        {
+            for (ThreadCounters* current = counterBlocks.load(std::memory_order_acquire); current != nullptr; current = current->next)
+            {
+                for (size_t i = 0; i < STATS_LEVELS; i++)
+                {
+                    stats.emitted[i] += current->emitted[i].load(std::memory_order_relaxed);
+                    stats.dropped[i] += current->dropped[i].load(std::memory_order_relaxed);
+                }
+
+                stats.declined += current->declined.load(std::memory_order_relaxed);
+                stats.suppressed += current->suppressed.load(std::memory_order_relaxed);
+                stats.truncated += current->truncated.load(std::memory_order_relaxed);
+                stats.timedRecords += current->timedRecords.load(std::memory_order_relaxed);
+                stats.formatNanoseconds += current->formatTime.load(std::memory_order_relaxed);
+                stats.writeNanoseconds += current->writeTime.load(std::memory_order_relaxed);
+                stats.otherBytes += current->otherBytes.load(std::memory_order_relaxed);
+                stats.otherWrites += current->otherWrites.load(std::memory_order_relaxed);
+
+                for (const SinkSlot& slot : current->sinks)
+                {
+                    Sink* sink = slot.sink.load(std::memory_order_acquire);
+                    if (sink == nullptr) continue;
+
+                    size_t index = 0;
+                    while (index < stats.sinkCount && stats.sinks[index].sink != sink) index++;
+
+                    if (index == LoggerStats::MAX_STATS_SINKS)
+                    {
+                        stats.otherBytes += slot.bytes.load(std::memory_order_relaxed);
+                        stats.otherWrites += slot.writes.load(std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    if (index == stats.sinkCount) stats.sinks[stats.sinkCount++].sink = sink;
+                    stats.sinks[index].bytes += slot.bytes.load(std::memory_order_relaxed);
+                    stats.sinks[index].writes += slot.writes.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        LoggerStats Logger::stats()
+        {
+            LoggerStats stats;
+            memset(&stats, 0, sizeof(stats));
+            ThreadCounters::sum(stats);
+
+            if (logger.asyncRunning.load(std::memory_order_acquire))
+            {
+                uint64_t retired = logger.retiredRecords.load(std::memory_order_acquire);
+                uint64_t pushed = logger.pushedRecords.load(std::memory_order_acquire);
+
+                stats.queueDepth = pushed > retired ? (size_t)(pushed - retired) : 0;
+                stats.queueCapacity = logger.asyncCapacity;
+            }
+
+            stats.queueHighWater = (size_t)logger.queueHighWater.load(std::memory_order_relaxed);
+            stats.arena = getArenaStats();
+            return stats;
+        }
+
+        void Logger::reportStats(WarningLevel _level)
+        {
+            LoggerStats current = stats();
+            uint64_t emitted = 0;
+            uint64_t dropped = 0;
+            uint64_t bytes = current.otherBytes;
+
+            for (size_t i = 0; i < STATS_LEVELS; i++)
+            {
+                emitted += current.emitted[i];
+                dropped += current.dropped[i];
+            }
+
+            for (size_t i = 0; i < current.sinkCount; i++) bytes += current.sinks[i].bytes;
+
+            uint64_t timed = current.timedRecords != 0 ? current.timedRecords : 1;
+
+            logger.logKV(_level, "logger stats",
+                         "emitted", emitted,
+                         "dropped", dropped,
+                         "declined", current.declined,
+                         "suppressed", current.suppressed,
+                         "truncated", current.truncated,
+                         "bytes", bytes,
+                         "format_ns", current.formatNanoseconds / timed,
+                         "write_ns", current.writeNanoseconds / timed,
+                         "queue_depth", current.queueDepth,
+                         "queue_high_water", current.queueHighWater,
+                         "arena_in_use", current.arena.inUseBytes);
+        }
+
+        // Held by pointer for the same reason as the config reloader thread.
+        static std::thread* reporterThread = nullptr;
+        static std::mutex reporterMutex;
+        static std::condition_variable reporterWakeup;
+        static std::atomic<bool> reporterRunning(false);
+
+        void Logger::startStatsReport(uint32_t intervalSeconds, WarningLevel _level)
+        {
+            stopStatsReport();
+            if (intervalSeconds == 0) return;
+
+            reporterRunning.store(true);
+            reporterThread = new std::thread([intervalSeconds, _level]()
+            {
+                std::unique_lock<std::mutex> lock(reporterMutex);
+
+                while (!reporterWakeup.wait_for(lock, std::chrono::seconds(intervalSeconds), []() { return !reporterRunning.load(); }))
+                {
+                    lock.unlock();
+                    reportStats(_level);
+                    lock.lock();
+                }
+            });
+        }
+
+        void Logger::stopStatsReport()
+        {
+            if (!reporterRunning.exchange(false)) return;
+
+            {
+                std::lock_guard<std::mutex> lock(reporterMutex);
+                reporterWakeup.notify_one();
+            }
+
+            reporterThread->join();
+            delete reporterThread;
+            reporterThread = nullptr;
+        }
+    }
+}
@@ -0,0 +1,231 @@
+#include "AKL/Structured.hpp"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AKL_STRUCTURED_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace AK
+{
+    namespace Log
+    {
+        void packField(RecordBuffer<char>& out, const FormatArg& key, const FormatArg& value)
+        {
+            out.append(key.text != nullptr ? key.text : "", key.length);
+            out.append("", 1);
+
+            bool isString = value.type == FORMAT_ARG_STRING || value.type == FORMAT_ARG_WSTRING;
+            bool isNull = isString && value.pointer == nullptr;
+            bool bare = isNull || value.type == FORMAT_ARG_BOOL || value.type == FORMAT_ARG_INT || value.type == FORMAT_ARG_UINT ||
+                        (value.type == FORMAT_ARG_DOUBLE && isfinite(value.d));
+
+            char kind = bare ? FIELD_BARE : FIELD_STRING;
+            out.append(&kind, 1);
+
+            if (isNull) out.append("null", 4);
+            else formatArg(out, value);
+            out.append("", 1);
+        }
+
+        // Finds the end of the field starting at packed: key, kind byte, value.
+        static size_t fieldEnd(const char* packed, size_t size)
+        {
+            size_t key = strnlen(packed, size);
+            if (key + 2 > size) return size;
+
+            return key + 2 + strnlen(packed + key + 2, size - key - 2) + 1;
+        }
+
+        size_t packedPrefix(const char* packed, size_t size, size_t limit)
+        {
+            size_t used = 0;
+
+            while (used < size)
+            {
+                size_t next = used + fieldEnd(packed + used, size - used);
+                if (next > limit) break;
+                used = next;
+            }
+
+            return used;
+        }
+
+        // JSON escapes quotes, backslashes and bytes below 0x20; logfmt additionally quotes
+        // values holding spaces or '='.
+        static bool needsEscape(unsigned char c)
+        {
+            return c < 0x20 || c == '"' || c == '\\';
+        }
+
+        static bool needsQuotes(unsigned char c)
+        {
+            return c <= 0x20 || c == '"' || c == '\\' || c == '=';
+        }
+
+        #if defined(AKL_STRUCTURED_SSE2)
+
+        // Skips whole 16-byte blocks free of bytes below limit, quotes, backslashes and extra,
+        // and returns the offset of the first block that holds one.
+        static size_t skipPlainBlocks(const char* text, size_t length, char limit, char extra)
+        {
+            const __m128i bias = _mm_set1_epi8((char)0x80);
+            const __m128i below = _mm_set1_epi8((char)(limit ^ 0x80));
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i other = _mm_set1_epi8(extra);
+            size_t i = 0;
+
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+
+                // SSE2 only compares signed bytes, so both sides are shifted by 0x80.
+                __m128i special = _mm_cmplt_epi8(_mm_xor_si128(block, bias), below);
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, quote));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, backslash));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, other));
+
+                if (_mm_movemask_epi8(special) != 0) break;
+            }
+
+            return i;
+        }
+
+        #else
+
+        static size_t skipPlainBlocks(const char*, size_t, char, char)
+        {
+            return 0;
+        }
+
+        #endif
+
+        void appendJsonString(RecordBuffer<char>& out, const char* text, size_t length)
+        {
+            static const char hex[] = "0123456789abcdef";
+            size_t start = 0;
+
+            while (start < length)
+            {
+                size_t i = start + skipPlainBlocks(text + start, length - start, 0x20, '"');
+                while (i < length && !needsEscape((unsigned char)text[i])) i++;
+
+                out.append(text + start, i - start);
+                if (i == length) break;
+
+                char escape[6] = { '\\', 0, 0, 0, 0, 0 };
+                size_t escapeLength = 2;
+                unsigned char c = (unsigned char)text[i];
+
+                switch (c)
+                {
+                    case '"': escape[1] = '"'; break;
+                    case '\\': escape[1] = '\\'; break;
+                    case '\n': escape[1] = 'n'; break;
+                    case '\r': escape[1] = 'r'; break;
+                    case '\t': escape[1] = 't'; break;
+                    case '\b': escape[1] = 'b'; break;
+                    case '\f': escape[1] = 'f'; break;
+                    default:
+                        escape[1] = 'u';
+                        escape[2] = '0';
+                        escape[3] = '0';
+                        escape[4] = hex[c >> 4];
+                        escape[5] = hex[c & 0xF];
+                        escapeLength = 6;
+                        break;
+                }
+
+                out.append(escape, escapeLength);
+                start = i + 1;
+            }
+        }
+
+        void appendLogfmtValue(RecordBuffer<char>& out, const char* text, size_t length)
+        {
+            size_t i = skipPlainBlocks(text, length, 0x21, '=');
+            while (i < length && !needsQuotes((unsigned char)text[i])) i++;
+
+            if (i == length && length != 0)
+            {
+                out.append(text, length);
+                return;
+            }
+
+            out.append("\"", 1);
+            appendJsonString(out, text, length);
+            out.append("\"", 1);
+        }
+
+        // logfmt keys cannot be quoted, so characters that would end them become '_'.
+        static void appendLogfmtKey(RecordBuffer<char>& out, const char* key, size_t length)
+        {
+            if (length == 0)
+            {
+                out.append("_", 1);
+                return;
+            }
+
+            char* dest = out.prepare(length);
+            if (dest == nullptr) return;
+
+            for (size_t i = 0; i < length; i++) dest[i] = needsQuotes((unsigned char)key[i]) ? '_' : key[i];
+            out.commit(length);
+        }
+
+        void appendJsonFields(RecordBuffer<char>& out, const char* packed, size_t size)
+        {
+            size_t offset = 0;
+
+            while (offset < size)
+            {
+                size_t end = offset + fieldEnd(packed + offset, size - offset);
+                const char* key = packed + offset;
+                size_t keyLength = strlen(key);
+                if (offset + keyLength + 2 > end) break;
+
+                char kind = key[keyLength + 1];
+                const char* value = key + keyLength + 2;
+                size_t valueLength = end - (offset + keyLength + 2) - 1;
+
+                out.append(",\"", 2);
+                appendJsonString(out, key, keyLength);
+                out.append("\":", 2);
+
+                if (kind == FIELD_BARE) out.append(value, valueLength);
+                else
+                {
+                    out.append("\"", 1);
+                    appendJsonString(out, value, valueLength);
+                    out.append("\"", 1);
+                }
+
+                offset = end;
+            }
+        }
+
+        void appendLogfmtFields(RecordBuffer<char>& out, const char* packed, size_t size)
+        {
+            size_t offset = 0;
+
+            while (offset < size)
+            {
+                size_t end = offset + fieldEnd(packed + offset, size - offset);
+                const char* key = packed + offset;
+                size_t keyLength = strlen(key);
+                if (offset + keyLength + 2 > end) break;
+
+                const char* value = key + keyLength + 2;
+                size_t valueLength = end - (offset + keyLength + 2) - 1;
+
+                out.append(" ", 1);
+                appendLogfmtKey(out, key, keyLength);
+                out.append("=", 1);
+                appendLogfmtValue(out, value, valueLength);
+
+                offset = end;
+            }
+        }
+    }
+}
@@ -0,0 +1,577 @@
+#include "AKL/log.hpp"
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define AKL_URING
+#endif
+#endif
+
+#if defined(AKL_URING)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace AK
+{
+    namespace Log
+    {
+        #if defined(AKL_URING)
+
+        // The mapped queues of the ring and the buffers. A buffer is free, filling or in flight;
+        // an in-flight one covers length bytes at offset, of which done have been written, and
+        // is either queued for submission or with the kernel. A failed ring takes no more
+        // submissions; its buffers are written with pwrite instead.
+        struct UringRing
+        {
+            static const uint32_t BUFFER_COUNT = UringFileSink::BUFFER_COUNT;
+
+            int ringFd;
+            int fd;
+            bool fixedFile;
+
+            void* sqRing;
+            size_t sqRingSize;
+            void* cqRing;
+            size_t cqRingSize;
+            io_uring_sqe* sqes;
+            size_t sqesSize;
+
+            unsigned* sqTail;
+            unsigned sqMask;
+            unsigned* sqArray;
+            unsigned* cqHead;
+            unsigned* cqTail;
+            unsigned cqMask;
+            io_uring_cqe* cqes;
+
+            char* buffers;
+            uint32_t freeList[BUFFER_COUNT];
+            uint32_t freeCount;
+            uint32_t filling;
+            size_t filled;
+
+            bool busy[BUFFER_COUNT];
+            uint64_t offset[BUFFER_COUNT];
+            uint32_t length[BUFFER_COUNT];
+            uint32_t done[BUFFER_COUNT];
+            uint32_t inFlight;
+            uint32_t queued[BUFFER_COUNT];
+            uint32_t queuedCount;
+            bool failed;
+
+            uint64_t nextOffset;
+            std::atomic<uint64_t> failedBytes;
+        };
+
+        static const uint32_t NO_BUFFER = UINT32_MAX;
+
+        static int ringSetup(unsigned entries, io_uring_params* params)
+        {
+            return (int)syscall(__NR_io_uring_setup, entries, params);
+        }
+
+        static int ringEnter(int ringFd, unsigned submit, unsigned wait, unsigned flags)
+        {
+            return (int)syscall(__NR_io_uring_enter, ringFd, submit, wait, flags, nullptr, 0);
+        }
+
+        static int ringRegister(int ringFd, unsigned opcode, const void* arg, unsigned count)
+        {
+            return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, count);
+        }
+
+        static void closeRing(UringRing* ring)
+        {
+            if (ring->sqes != nullptr) munmap(ring->sqes, ring->sqesSize);
+            if (ring->cqRing != nullptr && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+            if (ring->sqRing != nullptr) munmap(ring->sqRing, ring->sqRingSize);
+            if (ring->buffers != nullptr) munmap(ring->buffers, UringFileSink::BUFFER_SIZE * UringFileSink::BUFFER_COUNT);
+            if (ring->ringFd >= 0) close(ring->ringFd);
+            if (ring->fd >= 0) close(ring->fd);
+            delete ring;
+        }
+
+        // Sets up a ring with one submission slot per buffer, the file and the buffers
+        // registered. A file that cannot be registered is used by descriptor; buffers that
+        // cannot be registered, for instance over RLIMIT_MEMLOCK, mean no ring at all.
+        static UringRing* openRing(const char* path)
+        {
+            UringRing* ring = new UringRing();
+            ring->ringFd = -1;
+            ring->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+            struct stat info;
+            if (ring->fd < 0 || fstat(ring->fd, &info) != 0)
+            {
+                closeRing(ring);
+                return nullptr;
+            }
+            ring->nextOffset = (uint64_t)info.st_size;
+
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ring->ringFd = ringSetup(UringFileSink::BUFFER_COUNT, &params);
+            if (ring->ringFd < 0)
+            {
+                closeRing(ring);
+                return nullptr;
+            }
+
+            ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single && ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+
+            void* sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+            ring->sqRing = sqRing != MAP_FAILED ? sqRing : nullptr;
+
+            void* cqRing = single ? ring->sqRing : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+            ring->cqRing = cqRing != MAP_FAILED ? cqRing : nullptr;
+
+            ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+            ring->sqes = sqes != MAP_FAILED ? (io_uring_sqe*)sqes : nullptr;
+
+            void* buffers = mmap(nullptr, UringFileSink::BUFFER_SIZE * UringFileSink::BUFFER_COUNT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            ring->buffers = buffers != MAP_FAILED ? (char*)buffers : nullptr;
+
+            if (ring->sqRing == nullptr || ring->cqRing == nullptr || ring->sqes == nullptr || ring->buffers == nullptr)
+            {
+                closeRing(ring);
+                return nullptr;
+            }
+
+            char* sq = (char*)ring->sqRing;
+            char* cq = (char*)ring->cqRing;
+            ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+            ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+            ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+            ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+            ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+            ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+            ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+            struct iovec registered[UringFileSink::BUFFER_COUNT];
+            for (uint32_t i = 0; i < UringFileSink::BUFFER_COUNT; i++)
+            {
+                registered[i].iov_base = ring->buffers + i * UringFileSink::BUFFER_SIZE;
+                registered[i].iov_len = UringFileSink::BUFFER_SIZE;
+                ring->freeList[i] = UringFileSink::BUFFER_COUNT - 1 - i;
+            }
+
+            if (ringRegister(ring->ringFd, IORING_REGISTER_BUFFERS, registered, UringFileSink::BUFFER_COUNT) != 0)
+            {
+                closeRing(ring);
+                return nullptr;
+            }
+
+            ring->fixedFile = ringRegister(ring->ringFd, IORING_REGISTER_FILES, &ring->fd, 1) == 0;
+            ring->freeCount = UringFileSink::BUFFER_COUNT;
+            ring->filling = NO_BUFFER;
+            ring->failedBytes.store(0, std::memory_order_relaxed);
+            return ring;
+        }
+
+        // Returns the number of bytes written before an error.
+        static size_t writeAt(int fd, const char* data, size_t size, uint64_t offset)
+        {
+            size_t total = 0;
+
+            while (total < size)
+            {
+                ssize_t written = pwrite(fd, data + total, size - total, (off_t)(offset + total));
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                total += (size_t)written;
+            }
+
+            return total;
+        }
+
+        static void releaseBuffer(UringRing* ring, uint32_t index)
+        {
+            ring->busy[index] = false;
+            ring->inFlight--;
+            ring->freeList[ring->freeCount++] = index;
+        }
+
+        // Writes the rest of a buffer without the ring and counts what could not be written.
+        static void writeDirectly(UringRing* ring, uint32_t index)
+        {
+            size_t rest = ring->length[index] - ring->done[index];
+            size_t written = writeAt(ring->fd, ring->buffers + index * UringFileSink::BUFFER_SIZE + ring->done[index], rest, ring->offset[index] + ring->done[index]);
+
+            if (written < rest) ring->failedBytes.fetch_add(rest - written, std::memory_order_relaxed);
+            releaseBuffer(ring, index);
+        }
+
+        // Puts a write of the unwritten rest of the buffer on the submission queue. The queue
+        // has a slot per buffer and a buffer is never queued twice, so there is always room.
+        static void queueBuffer(UringRing* ring, uint32_t index)
+        {
+            if (ring->failed)
+            {
+                writeDirectly(ring, index);
+                return;
+            }
+
+            unsigned tail = *ring->sqTail;
+            unsigned slot = tail & ring->sqMask;
+            io_uring_sqe* sqe = &ring->sqes[slot];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->flags = ring->fixedFile ? IOSQE_FIXED_FILE : 0;
+            sqe->fd = ring->fixedFile ? 0 : ring->fd;
+            sqe->off = ring->offset[index] + ring->done[index];
+            sqe->addr = (uint64_t)(uintptr_t)(ring->buffers + index * UringFileSink::BUFFER_SIZE + ring->done[index]);
+            sqe->len = ring->length[index] - ring->done[index];
+            sqe->buf_index = (uint16_t)index;
+            sqe->user_data = index;
+
+            ring->sqArray[slot] = slot;
+            __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+            ring->queued[ring->queuedCount++] = index;
+        }
+
+        // Stops using the ring. The writes the kernel has not taken yet are taken back off the
+        // submission queue and written with pwrite.
+        static void failRing(UringRing* ring)
+        {
+            ring->failed = true;
+            __atomic_store_n(ring->sqTail, *ring->sqTail - ring->queuedCount, __ATOMIC_RELEASE);
+
+            uint32_t count = ring->queuedCount;
+            ring->queuedCount = 0;
+            for (uint32_t i = 0; i < count; i++) writeDirectly(ring, ring->queued[i]);
+        }
+
+        // Takes in the finished writes: the rest of short or interrupted ones is queued again,
+        // and buffers that are done go back on the free list. The bytes of a write that fails
+        // for good are counted.
+        static void collect(UringRing* ring)
+        {
+            unsigned head = *ring->cqHead;
+            unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+            while (head != tail)
+            {
+                const io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+                uint32_t index = (uint32_t)cqe->user_data;
+                int result = cqe->res;
+
+                head++;
+                __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+                if (result == -EINTR || result == -EAGAIN)
+                {
+                    queueBuffer(ring, index);
+                    continue;
+                }
+
+                if (result > 0)
+                {
+                    ring->done[index] += (uint32_t)result;
+                    if (ring->done[index] < ring->length[index]) queueBuffer(ring, index);
+                    else releaseBuffer(ring, index);
+                    continue;
+                }
+
+                ring->failedBytes.fetch_add(ring->length[index] - ring->done[index], std::memory_order_relaxed);
+                releaseBuffer(ring, index);
+            }
+        }
+
+        // Hands the queued writes to the kernel. A full completion queue (EBUSY) is drained
+        // before trying again; any other error fails the ring.
+        static void submitQueued(UringRing* ring)
+        {
+            while (ring->queuedCount != 0)
+            {
+                int submitted = ringEnter(ring->ringFd, ring->queuedCount, 0, 0);
+
+                if (submitted > 0)
+                {
+                    ring->queuedCount -= (uint32_t)submitted;
+                    memmove(ring->queued, ring->queued + submitted, ring->queuedCount * sizeof(uint32_t));
+                    continue;
+                }
+
+                if (submitted < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+
+                if (submitted < 0 && errno == EBUSY)
+                {
+                    collect(ring);
+                    continue;
+                }
+
+                failRing(ring);
+            }
+        }
+
+        static void reap(UringRing* ring)
+        {
+            collect(ring);
+            submitQueued(ring);
+        }
+
+        static void submitFilling(UringRing* ring)
+        {
+            uint32_t index = ring->filling;
+            if (index == NO_BUFFER || ring->filled == 0) return;
+
+            ring->offset[index] = ring->nextOffset;
+            ring->length[index] = (uint32_t)ring->filled;
+            ring->done[index] = 0;
+            ring->busy[index] = true;
+            ring->nextOffset += ring->filled;
+            ring->inFlight++;
+
+            ring->filling = NO_BUFFER;
+            ring->filled = 0;
+            queueBuffer(ring, index);
+            submitQueued(ring);
+        }
+
+        // When the ring cannot even be waited on, the buffers still with the kernel are written
+        // again with pwrite, which rewrites the same bytes at the same offsets, and the ring is
+        // not used again.
+        static void waitForCompletion(UringRing* ring)
+        {
+            while (ringEnter(ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+            {
+                if (errno == EINTR) continue;
+
+                ring->failed = true;
+                for (uint32_t i = 0; i < UringFileSink::BUFFER_COUNT; i++)
+                {
+                    if (ring->busy[i]) writeDirectly(ring, i);
+                }
+                return;
+            }
+
+            reap(ring);
+        }
+
+        UringFileSink::UringFileSink(const char* path)
+            : ring(openRing(path)), fallback(nullptr), stallCount(0), running(true)
+        {
+            if (ring == nullptr)
+            {
+                fallback = new FileSink(path);
+                return;
+            }
+
+            maintenanceThread = std::thread(&UringFileSink::maintain, this);
+        }
+
+        UringFileSink::~UringFileSink()
+        {
+            if (ring == nullptr)
+            {
+                delete fallback;
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(maintenanceMutex);
+                running = false;
+                maintenanceWakeup.notify_one();
+            }
+
+            maintenanceThread.join();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            submitFilling(ring);
+            reap(ring);
+            while (ring->inFlight != 0) waitForCompletion(ring);
+            closeRing(ring);
+        }
+
+        void UringFileSink::write(const char* data, size_t size)
+        {
+            if (ring == nullptr)
+            {
+                fallback->write(data, size);
+                return;
+            }
+
+            if (crashing.load(std::memory_order_relaxed))
+            {
+                emergencyWrite(data, size);
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (size > 0)
+            {
+                if (ring->filling == NO_BUFFER)
+                {
+                    if (ring->freeCount == 0) reap(ring);
+                    if (ring->freeCount == 0) stallCount.fetch_add(1, std::memory_order_relaxed);
+                    while (ring->freeCount == 0) waitForCompletion(ring);
+
+                    ring->filling = ring->freeList[--ring->freeCount];
+                    ring->filled = 0;
+                }
+
+                size_t room = BUFFER_SIZE - ring->filled;
+                size_t part = size < room ? size : room;
+
+                memcpy(ring->buffers + ring->filling * BUFFER_SIZE + ring->filled, data, part);
+                ring->filled += part;
+                data += part;
+                size -= part;
+
+                if (ring->filled == BUFFER_SIZE) submitFilling(ring);
+            }
+        }
+
+        void UringFileSink::flush()
+        {
+            if (ring == nullptr)
+            {
+                fallback->flush();
+                return;
+            }
+
+            if (crashing.load(std::memory_order_relaxed)) return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            submitFilling(ring);
+            reap(ring);
+        }
+
+        // Both skip the lock like FileSink's. Buffers still in flight are written again with
+        // pwrite: a ring torn down with the process may cancel them, and rewriting the same
+        // bytes at the same offset is harmless.
+        void UringFileSink::emergencyFlush()
+        {
+            if (ring == nullptr)
+            {
+                fallback->emergencyFlush();
+                return;
+            }
+
+            for (uint32_t i = 0; i < BUFFER_COUNT; i++)
+            {
+                if (ring->busy[i]) writeAt(ring->fd, ring->buffers + i * BUFFER_SIZE, ring->length[i], ring->offset[i]);
+            }
+
+            size_t pending = ring->filled;
+            if (ring->filling == NO_BUFFER || pending == 0) return;
+
+            writeAt(ring->fd, ring->buffers + ring->filling * BUFFER_SIZE, pending, ring->nextOffset);
+            ring->nextOffset += pending;
+            ring->filled = 0;
+        }
+
+        void UringFileSink::emergencyWrite(const char* data, size_t size)
+        {
+            if (ring == nullptr)
+            {
+                fallback->emergencyWrite(data, size);
+                return;
+            }
+
+            writeAt(ring->fd, data, size, ring->nextOffset);
+            ring->nextOffset += size;
+        }
+
+        bool UringFileSink::isOpen() const
+        {
+            return ring != nullptr || fallback->isOpen();
+        }
+
+        bool UringFileSink::usesUring() const
+        {
+            return ring != nullptr;
+        }
+
+        uint64_t UringFileSink::failedBytes() const
+        {
+            return ring != nullptr ? ring->failedBytes.load(std::memory_order_relaxed) : 0;
+        }
+
+        #else
+
+        UringFileSink::UringFileSink(const char* path)
+            : ring(nullptr), fallback(new FileSink(path)), stallCount(0), running(false)
+        {
+        }
+
+        UringFileSink::~UringFileSink()
+        {
+            delete fallback;
+        }
+
+        void UringFileSink::write(const char* data, size_t size)
+        {
+            fallback->write(data, size);
+        }
+
+        void UringFileSink::flush()
+        {
+            fallback->flush();
+        }
+
+        void UringFileSink::emergencyFlush()
+        {
+            fallback->emergencyFlush();
+        }
+
+        void UringFileSink::emergencyWrite(const char* data, size_t size)
+        {
+            fallback->emergencyWrite(data, size);
+        }
+
+        bool UringFileSink::isOpen() const
+        {
+            return fallback->isOpen();
+        }
+
+        bool UringFileSink::usesUring() const
+        {
+            return false;
+        }
+
+        uint64_t UringFileSink::failedBytes() const
+        {
+            return 0;
+        }
+
+        #endif
+
+        uint64_t UringFileSink::stalls() const
+        {
+            return stallCount.load(std::memory_order_relaxed);
+        }
+
+        void UringFileSink::maintain()
+        {
+            std::unique_lock<std::mutex> lock(maintenanceMutex);
+
+            while (running)
+            {
+                maintenanceWakeup.wait_for(lock, std::chrono::milliseconds((int64_t)FLUSH_INTERVAL_MS), [this]() { return !running; });
+                if (!running) break;
+
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+    }
+}
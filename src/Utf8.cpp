@@ -0,0 +1,361 @@
+#include "AKL/Utf8.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AKL_UTF8_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(AKL_UTF8_SSE2) && defined(_MSC_VER)
+#include <intrin.h>
+#define AKL_TARGET_AVX2
+#elif defined(AKL_UTF8_SSE2)
+#define AKL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace AK
+{
+    namespace Log
+    {
+        #if defined(AKL_UTF8_SSE2)
+
+        static bool detectAvx2()
+        {
+            #if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            __cpuidex(info, 7, 0);
+            bool avx2 = (info[1] & (1 << 5)) != 0;
+            return osxsave && avx2 && (_xgetbv(0) & 6) == 6;
+            #else
+            return __builtin_cpu_supports("avx2");
+            #endif
+        }
+
+        // Read before static initialisation finishes it is false, which only costs the SSE2 path.
+        static const bool hasAvx2 = detectAvx2();
+
+        // Each of the following converts whole blocks from the start of src while they are pure
+        // ASCII and returns the number of units converted.
+        static size_t asciiToUtf8Sse2(const wchar_t* src, size_t length, char* dest)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+
+            if constexpr (sizeof(wchar_t) == 4)
+            {
+                const __m128i high = _mm_set1_epi32(~0x7F);
+
+                for (; i + 16 <= length; i += 16)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+                    __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 8));
+                    __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 12));
+
+                    __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, high), zero)) != 0xFFFF) break;
+
+                    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                    _mm_storeu_si128((__m128i*)(dest + i), bytes);
+                }
+            }
+            else
+            {
+                const __m128i high = _mm_set1_epi16(~0x7F);
+
+                for (; i + 16 <= length; i += 16)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+
+                    __m128i any = _mm_or_si128(a, b);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(any, high), zero)) != 0xFFFF) break;
+
+                    _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(a, b));
+                }
+            }
+
+            return i;
+        }
+
+        AKL_TARGET_AVX2 static size_t asciiToUtf8Avx2(const wchar_t* src, size_t length, char* dest)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            size_t i = 0;
+
+            if constexpr (sizeof(wchar_t) == 4)
+            {
+                const __m256i high = _mm256_set1_epi32(~0x7F);
+                const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+                for (; i + 32 <= length; i += 32)
+                {
+                    __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+                    __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+                    __m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+                    __m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 24));
+
+                    __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+                    if (!_mm256_testz_si256(any, high)) break;
+
+                    // The packs work per 128-bit lane; the permute restores the source order.
+                    __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+                    _mm256_storeu_si256((__m256i*)(dest + i), _mm256_permutevar8x32_epi32(bytes, order));
+                }
+            }
+            else
+            {
+                const __m256i high = _mm256_set1_epi16(~0x7F);
+
+                for (; i + 32 <= length; i += 32)
+                {
+                    __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+                    __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+
+                    if (!_mm256_testz_si256(_mm256_or_si256(a, b), high)) break;
+
+                    __m256i bytes = _mm256_packus_epi16(a, b);
+                    _mm256_storeu_si256((__m256i*)(dest + i), _mm256_permute4x64_epi64(bytes, 0xD8));
+                }
+            }
+
+            (void)zero;
+            return i;
+        }
+
+        static size_t asciiToWideSse2(const char* src, size_t length, wchar_t* dest)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+                if (_mm_movemask_epi8(bytes) != 0) break;
+
+                __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+                if constexpr (sizeof(wchar_t) == 4)
+                {
+                    _mm_storeu_si128((__m128i*)(dest + i), _mm_unpacklo_epi16(low, zero));
+                    _mm_storeu_si128((__m128i*)(dest + i + 4), _mm_unpackhi_epi16(low, zero));
+                    _mm_storeu_si128((__m128i*)(dest + i + 8), _mm_unpacklo_epi16(high, zero));
+                    _mm_storeu_si128((__m128i*)(dest + i + 12), _mm_unpackhi_epi16(high, zero));
+                }
+                else
+                {
+                    _mm_storeu_si128((__m128i*)(dest + i), low);
+                    _mm_storeu_si128((__m128i*)(dest + i + 8), high);
+                }
+            }
+
+            return i;
+        }
+
+        AKL_TARGET_AVX2 static size_t asciiToWideAvx2(const char* src, size_t length, wchar_t* dest)
+        {
+            size_t i = 0;
+
+            for (; i + 32 <= length; i += 32)
+            {
+                __m256i bytes = _mm256_loadu_si256((const __m256i*)(src + i));
+                if (_mm256_movemask_epi8(bytes) != 0) break;
+
+                if constexpr (sizeof(wchar_t) == 4)
+                {
+                    for (size_t j = 0; j < 32; j += 8)
+                    {
+                        __m128i part = _mm_loadl_epi64((const __m128i*)(src + i + j));
+                        _mm256_storeu_si256((__m256i*)(dest + i + j), _mm256_cvtepu8_epi32(part));
+                    }
+                }
+                else
+                {
+                    _mm256_storeu_si256((__m256i*)(dest + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+                    _mm256_storeu_si256((__m256i*)(dest + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+                }
+            }
+
+            return i;
+        }
+
+        static size_t asciiToUtf8(const wchar_t* src, size_t length, char* dest)
+        {
+            return hasAvx2 ? asciiToUtf8Avx2(src, length, dest) : asciiToUtf8Sse2(src, length, dest);
+        }
+
+        static size_t asciiToWide(const char* src, size_t length, wchar_t* dest)
+        {
+            return hasAvx2 ? asciiToWideAvx2(src, length, dest) : asciiToWideSse2(src, length, dest);
+        }
+
+        #else
+
+        static size_t asciiToUtf8(const wchar_t*, size_t, char*)
+        {
+            return 0;
+        }
+
+        static size_t asciiToWide(const char*, size_t, wchar_t*)
+        {
+            return 0;
+        }
+
+        #endif
+
+        // After a block the vector path rejected, this many units go through the scalar loop
+        // before it is tried again.
+        static const size_t SCALAR_RUN = 32;
+
+        size_t wideToUtf8(const wchar_t* src, size_t length, char* dest)
+        {
+            size_t i = 0;
+            size_t written = 0;
+
+            while (i < length)
+            {
+                size_t ascii = asciiToUtf8(src + i, length - i, dest + written);
+                i += ascii;
+                written += ascii;
+
+                size_t end = length - i > SCALAR_RUN ? i + SCALAR_RUN : length;
+
+                while (i < end)
+                {
+                    uint32_t codePoint = (uint32_t)src[i++];
+
+                    if (codePoint < 0x80)
+                    {
+                        dest[written++] = (char)codePoint;
+                        continue;
+                    }
+
+                    if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint < 0xDC00 && i < length)
+                    {
+                        uint32_t low = (uint32_t)src[i];
+                        if (low >= 0xDC00 && low < 0xE000)
+                        {
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                            i++;
+                        }
+                    }
+
+                    written += encodeUtf8(codePoint, dest + written);
+                }
+            }
+
+            return written;
+        }
+
+        static size_t putCodePoint(uint32_t codePoint, wchar_t* dest)
+        {
+            if (sizeof(wchar_t) == 2 && codePoint >= 0x10000)
+            {
+                dest[0] = (wchar_t)(0xD800 + ((codePoint - 0x10000) >> 10));
+                dest[1] = (wchar_t)(0xDC00 + (codePoint & 0x3FF));
+                return 2;
+            }
+
+            dest[0] = (wchar_t)codePoint;
+            return 1;
+        }
+
+        size_t utf8ToWide(const char* src, size_t length, wchar_t* dest)
+        {
+            const unsigned char* bytes = (const unsigned char*)src;
+            size_t i = 0;
+            size_t written = 0;
+
+            while (i < length)
+            {
+                size_t ascii = asciiToWide(src + i, length - i, dest + written);
+                i += ascii;
+                written += ascii;
+
+                size_t end = length - i > SCALAR_RUN ? i + SCALAR_RUN : length;
+
+                while (i < end)
+                {
+                    uint32_t lead = bytes[i];
+
+                    if (lead < 0x80)
+                    {
+                        dest[written++] = (wchar_t)lead;
+                        i++;
+                        continue;
+                    }
+
+                    size_t extra = 0;
+                    uint32_t minimum = 0;
+                    uint32_t codePoint = 0xFFFD;
+
+                    if (lead >= 0xC2 && lead <= 0xDF) extra = 1, minimum = 0x80;
+                    else if (lead >= 0xE0 && lead <= 0xEF) extra = 2, minimum = 0x800;
+                    else if (lead >= 0xF0 && lead <= 0xF4) extra = 3, minimum = 0x10000;
+
+                    size_t consumed = 1;
+
+                    if (extra != 0)
+                    {
+                        uint32_t value = lead & (0x3F >> extra);
+
+                        while (consumed <= extra && i + consumed < length && (bytes[i + consumed] & 0xC0) == 0x80)
+                        {
+                            value = (value << 6) | (bytes[i + consumed] & 0x3F);
+                            consumed++;
+                        }
+
+                        bool complete = consumed == extra + 1;
+                        bool surrogate = value >= 0xD800 && value < 0xE000;
+                        if (complete && value >= minimum && !surrogate && value < 0x110000) codePoint = value;
+                    }
+
+                    written += putCodePoint(codePoint, dest + written);
+                    i += consumed;
+                }
+            }
+
+            return written;
+        }
+
+        // Converts straight into the record's free space; only near the buffer's size limit
+        // does it go through a small block so append() can truncate.
+        void appendUtf8(RecordBuffer<char>& out, const wchar_t* text, size_t length)
+        {
+            char* dest = out.prepare(length * UTF8_MAX_PER_WCHAR);
+
+            if (dest != nullptr)
+            {
+                out.commit(wideToUtf8(text, length, dest));
+                return;
+            }
+
+            char block[256 * UTF8_MAX_PER_WCHAR];
+            for (size_t i = 0; i < length; i += 256)
+            {
+                size_t count = length - i < 256 ? length - i : 256;
+                out.append(block, wideToUtf8(text + i, count, block));
+            }
+        }
+
+        void appendWide(RecordBuffer<wchar_t>& out, const char* text, size_t length)
+        {
+            wchar_t* dest = out.prepare(length);
+
+            if (dest != nullptr)
+            {
+                out.commit(utf8ToWide(text, length, dest));
+                return;
+            }
+
+            wchar_t block[256];
+            for (size_t i = 0; i < length; i += 256)
+            {
+                size_t count = length - i < 256 ? length - i : 256;
+                out.append(block, utf8ToWide(text + i, count, block));
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#include "include/AKL/Utf8.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <wchar.h>
+#include <chrono>
+#include <vector>
+
+// Compares the logger's wide to UTF-8 transcoder against wcstombs on log-sized messages.
+static double measure(const wchar_t* text, size_t length, bool library, size_t& bytes)
+{
+    static const int ROUNDS = 200000;
+    std::vector<char> out(length * AK::Log::UTF8_MAX_PER_WCHAR + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        bytes = library ? wcstombs(out.data(), text, out.size()) : AK::Log::wideToUtf8(text, length, out.data());
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return (double)length * sizeof(wchar_t) * ROUNDS / elapsed / (1024.0 * 1024.0);
+}
+
+static void run(const char* name, const wchar_t* text)
+{
+    size_t length = wcslen(text);
+    size_t bytesAkl = 0;
+    size_t bytesLibrary = 0;
+
+    double akl = measure(text, length, false, bytesAkl);
+    double library = measure(text, length, true, bytesLibrary);
+
+    printf("%-8s %4zu chars  wideToUtf8 %8.1f MiB/s  wcstombs %8.1f MiB/s  (%zu/%zu bytes)\n",
+           name, length, akl, library, bytesAkl, bytesLibrary);
+}
+
+int main()
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    run("ascii", L"[INFO 2024/01/01 12:00:00]: request served in 12ms from cache, user=42 path=/api/v1/items");
+    run("latin", L"[INFO 2024/01/01 12:00:00]: Grüße aus Köln, café crème, señor Müller, déjà vu");
+    run("mixed", L"[INFO 2024/01/01 12:00:00]: π ≈ 3.14159, 日本語のログ, Ω, mostly ascii text after it");
+    run("cjk", L"日本語のログメッセージです。東京都渋谷区で処理が完了しました。");
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "include/AKL/log.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+
+// Crashes a child process right after it logs and checks that every record reached the file
+// through the crash handler. POSIX only.
+static const int RECORDS = 2000;
+
+static void crashingChild(const char* path, bool async, int crash)
+{
+    AK::Log::FileSink sink(path);
+    AK::Log::Logger* log = AK::Log::Logger::get();
+    log->setSink(&sink);
+    log->setThreshold(AK::Log::LEVEL_INFO);
+    AK::Log::Logger::installCrashHandler();
+
+    if (async) log->startAsync(4096, AK::Log::OVERFLOW_BLOCK);
+
+    for (int i = 0; i < RECORDS; i++) LOG_INFO_KV("record", "index", i);
+
+    if (crash == SIGSEGV) *(volatile int*)nullptr = 0;
+    abort();
+}
+
+static bool run(const char* name, bool async, int crash)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/akl-crash-%d.log", (int)getpid());
+    remove(path);
+
+    pid_t child = fork();
+    if (child == 0) crashingChild(path, async, crash);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::string contents;
+    if (FILE* file = fopen(path, "rb"))
+    {
+        char chunk[4096];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) != 0) contents.append(chunk, read);
+        fclose(file);
+    }
+    remove(path);
+
+    int found = 0;
+    for (int i = 0; i < RECORDS; i++)
+    {
+        std::string key = "index=" + std::to_string(i) + "\n";
+        if (contents.find(key) != std::string::npos) found++;
+    }
+
+    bool passed = WIFSIGNALED(status) && WTERMSIG(status) == crash && found == RECORDS;
+    printf("%s %s: %d/%d records, %s\n", passed ? "PASS" : "FAIL", name, found, RECORDS, WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "no signal");
+    return passed;
+}
+
+int main()
+{
+    bool passed = run("sync SIGSEGV", false, SIGSEGV);
+    passed &= run("sync SIGABRT", false, SIGABRT);
+    passed &= run("async SIGSEGV", true, SIGSEGV);
+    passed &= run("async SIGABRT", true, SIGABRT);
+
+    return passed ? 0 : 1;
+}
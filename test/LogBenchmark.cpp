@@ -0,0 +1,275 @@
+#include "include/AKL/log.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define AKL_BENCH_RDTSC
+#endif
+
+// Throughput, thread scaling and per-call latency of the logging calls, written through a
+// FileSink to /dev/null, a file and a pipe and through a UringFileSink to a file,
+// synchronously and through the async queue.
+// POSIX only. Usage: LogBenchmark [calls per run] [file path]
+//
+// Numbers are comparable between builds of the same machine only; run it before and after
+// every change to the logging path.
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = malloc(size != 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+// GCC takes the replaced operators for the library ones and warns about free().
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { operator delete(memory); }
+void operator delete(void* memory, size_t) noexcept { operator delete(memory); }
+void operator delete[](void* memory, size_t) noexcept { operator delete(memory); }
+
+// Counts what reaches the real sink, which sees whole records only.
+class CountingSink : public AK::Log::Sink
+{
+public:
+    CountingSink(AK::Log::Sink* _inner) : inner(_inner), bytes(0) {}
+
+    void write(const char* data, size_t size) override
+    {
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        inner->write(data, size);
+    }
+
+    void flush() override { inner->flush(); }
+
+    AK::Log::Sink* inner;
+    std::atomic<uint64_t> bytes;
+};
+
+typedef void (*Call)(int i);
+
+struct Variant
+{
+    const char* name;
+    Call call;
+};
+
+static const Variant VARIANTS[] =
+{
+    { "logInfo", [](int i) { AK::Log::Logger::get()->logInfo("request %d served in %d us from %s", i, 42, "cache"); } },
+    { "LOG_INFO_ARGS", [](int i) { LOG_INFO_ARGS("request {} served in {} us from {}", i, 42, "cache"); } },
+    { "logInfoW", [](int i) { AK::Log::Logger::get()->logInfoW(L"request %d served in %d us from %ls", i, 42, L"cache"); } },
+    { "LOG_INFO_ARGS_WIDE", [](int i) { LOG_INFO_ARGS_WIDE(L"request {} served in {} us from {}", i, 42, L"cache"); } },
+};
+
+static int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(AKL_BENCH_RDTSC)
+
+static uint64_t ticks() { return __rdtsc(); }
+
+// rdtsc ticks per nanosecond, measured against the steady clock once.
+static double ticksPerNanosecond()
+{
+    static double rate = 0;
+    if (rate != 0) return rate;
+
+    int64_t start = now();
+    uint64_t startTicks = ticks();
+    while (now() - start < 50000000) {}
+    rate = (double)(ticks() - startTicks) / (double)(now() - start);
+    return rate;
+}
+
+#else
+
+static uint64_t ticks() { return (uint64_t)now(); }
+static double ticksPerNanosecond() { return 1; }
+
+#endif
+
+// Starts the threads together and returns the wall time until the last record is written.
+static double runThreads(Call call, int calls, int threads)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++)
+    {
+        int begin = (int)((int64_t)calls * t / threads);
+        int end = (int)((int64_t)calls * (t + 1) / threads);
+
+        workers.emplace_back([&, begin, end]()
+        {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {}
+            for (int i = begin; i < end; i++) call(i);
+        });
+    }
+
+    while (ready.load() != threads) {}
+    int64_t start = now();
+    go.store(true, std::memory_order_release);
+
+    for (std::thread& worker : workers) worker.join();
+    AK::Log::Logger::get()->flush();
+
+    return (double)(now() - start) / 1e9;
+}
+
+static void throughput(const Variant& variant, CountingSink& sink, int calls)
+{
+    variant.call(-1);
+    AK::Log::Logger::get()->flush();
+
+    uint64_t bytesBefore = sink.bytes.load();
+    uint64_t allocationsBefore = allocations.load();
+    double seconds = runThreads(variant.call, calls, 1);
+    uint64_t bytes = sink.bytes.load() - bytesBefore;
+    uint64_t allocated = allocations.load() - allocationsBefore;
+
+    printf("    %-20s %10.0f calls/s %9.1f MiB/s %8.3f new/call\n",
+           variant.name, calls / seconds, bytes / seconds / (1024.0 * 1024.0), (double)allocated / calls);
+}
+
+static void scaling(const Variant& variant, int calls)
+{
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores < 1) cores = 1;
+
+    printf("    %-20s", variant.name);
+    for (int threads = 1; ; threads *= 2)
+    {
+        if (threads > cores) threads = cores;
+
+        double seconds = runThreads(variant.call, calls, threads);
+        printf(" %dT %.0f/s", threads, calls / seconds);
+
+        if (threads == cores) break;
+    }
+    printf("\n");
+}
+
+// Times every call on one thread; in async mode that is the cost to the caller, not the
+// time until the record is written.
+static void latency(const Variant& variant, int calls)
+{
+    std::vector<uint64_t> samples((size_t)calls);
+    variant.call(-1);
+    AK::Log::Logger::get()->flush();
+
+    for (int i = 0; i < calls; i++)
+    {
+        uint64_t start = ticks();
+        variant.call(i);
+        samples[i] = ticks() - start;
+    }
+    AK::Log::Logger::get()->flush();
+
+    std::sort(samples.begin(), samples.end());
+    double scale = 1.0 / ticksPerNanosecond();
+    auto percentile = [&](double p) { return samples[(size_t)(p * (calls - 1))] * scale; };
+
+    printf("    %-20s p50 %7.0f ns  p99 %7.0f ns  p99.9 %8.0f ns  max %9.0f ns\n",
+           variant.name, percentile(0.5), percentile(0.99), percentile(0.999), samples.back() * scale);
+}
+
+template<typename TargetSink>
+static void runTarget(const char* target, const char* path, int calls)
+{
+    AK::Log::Logger* log = AK::Log::Logger::get();
+
+    for (int async = 0; async < 2; async++)
+    {
+        TargetSink file(path);
+        CountingSink sink(&file);
+        log->setSink(&sink);
+        if (async) log->startAsync(65536, AK::Log::OVERFLOW_BLOCK);
+
+        printf("%s, %s\n  throughput (1 thread)\n", target, async ? "async" : "sync");
+        for (const Variant& variant : VARIANTS) throughput(variant, sink, calls);
+
+        printf("  scaling (%d calls split across threads)\n", calls);
+        for (const Variant& variant : VARIANTS) scaling(variant, calls);
+
+        printf("  latency per call\n");
+        for (const Variant& variant : VARIANTS) latency(variant, calls);
+
+        if (async) log->stopAsync();
+        log->setSink(nullptr);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int calls = argc > 1 ? atoi(argv[1]) : 200000;
+    const char* filePath = argc > 2 ? argv[2] : "akl-benchmark.log";
+    if (calls < 1) calls = 1;
+
+    AK::Log::Logger::get()->setThreshold(AK::Log::LEVEL_INFO);
+    ticksPerNanosecond();
+
+    runTarget<AK::Log::FileSink>("/dev/null", "/dev/null", calls);
+
+    remove(filePath);
+    runTarget<AK::Log::FileSink>("file", filePath, calls);
+    remove(filePath);
+    runTarget<AK::Log::UringFileSink>("file (io_uring)", filePath, calls);
+    remove(filePath);
+
+    // The reader drains the pipe as fast as it can, so the pipe only throttles the logger
+    // when it cannot keep up.
+    int pipeFds[2];
+    if (pipe(pipeFds) == 0)
+    {
+        std::thread reader([&]()
+        {
+            char chunk[65536];
+            while (read(pipeFds[0], chunk, sizeof(chunk)) > 0) {}
+        });
+
+        char pipePath[64];
+        snprintf(pipePath, sizeof(pipePath), "/dev/fd/%d", pipeFds[1]);
+        runTarget<AK::Log::FileSink>("pipe", pipePath, calls);
+
+        close(pipeFds[1]);
+        reader.join();
+        close(pipeFds[0]);
+    }
+
+    return 0;
+}
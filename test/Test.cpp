@@ -1,10 +1,27 @@
 #include "include/AKL/log.hpp"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+
+// Counts warnings without ever having a record formatted for it.
+class WarningCounter : public AK::Log::Sink
+{
+public:
+    bool accept(const AK::Log::Record& record) override
+    {
+        if (record.level >= AK::Log::LEVEL_WARNING) count++;
+        return false;
+    }
+
+    void write(const char*, size_t) override {}
+
+    int count = 0;
+};
 
 int main() 
 {
     AK::Log::Logger log("[%l %d %t]: %s\n", L"[%l %d %t]: %s\n", AK::Log::WarningLevel::LEVEL_TRACE);
+    AK::Log::Logger::installCrashHandler(); // on a crash, buffered and queued records are written out before the process dies
     
     log.logTrace("trace test %c", 0x3C0);
     log.logDebug("debug test %c", 0x3C0);
@@ -21,8 +38,102 @@ int main()
     log.logFatalW(L"wide fatal test %c", 0x3C0);
 
     LOG_INFO_ARGS("%c", 0x3C0); // prints the ASCII interpretation of the bits of the utf-16 PI symbol
-    LOG_INFO_ARGS_WIDE(L"%c", 0x3C0); // prints the utf-16 PI symbol
+    LOG_INFO_ARGS_WIDE(L"%c", 0x3C0); // prints the PI symbol, transcoded to utf-8 like every wide record
+    LOG_INFO_ARGS_WIDE(L"%ls", L"unpaired \xD800 surrogate"); // invalid code units print as U+FFFD
 
     LOG_ASSERT(0, "Assert prints propperly!"); // prints the file with line in the format: 'file:line' then prints the passed in message
     LOG_ASSERT(1, "Assert prints propperly!"); // prints nothing
+
+    AK::Log::Logger::get()->setThreshold(AK::Log::WarningLevel::LEVEL_WARNING);
+    LOG_INFO_ARGS("filtered %d", rand()); // below the threshold, rand() is never called
+    LOG_WARNING("threshold test"); // still printed
+    AK::Log::Logger::get()->setThreshold(AK::Log::WarningLevel::LEVEL_TRACE);
+
+    AK::Log::Logger* http = AK::Log::Logger::get("net.http"); // creates "net" as its parent, the handle stays valid
+    AK::Log::Logger::get("net")->setThreshold(AK::Log::WarningLevel::LEVEL_ERROR);
+    LOG_INFO_ARGS_TO(http, "filtered by net %d", rand()); // inherited ERROR threshold, costs one load
+    LOG_ERROR_ARGS_TO(http, "named logger test {}", http->getName()); // written to the root's sinks
+    AK::Log::Logger::get("net")->inheritThreshold();
+
+    AK::Log::Logger::setSampling(AK::Log::LEVEL_DEBUG, 1000, AK::Log::SAMPLING_RANDOM); // keeps about 1 in 1000 LOG_DEBUG* records
+    for (int i = 0; i < 10000; i++) LOG_DEBUG_ARGS("sampling test %d", rand()); // rand() only runs for the kept records
+    AK::Log::Logger::setSampling(AK::Log::LEVEL_DEBUG, 0, AK::Log::SAMPLING_COUNTED);
+    for (int i = 0; i < 30; i++) LOG_DEBUG_ARGS_SAMPLED(10, "site sampling test %d", i); // prints 0, 10 and 20; "%r" in a layout prints the 10
+
+    AK::Log::Logger::setRateLimit(10, 3); // each call site: bursts of 3, then 10 records per second
+    for (int i = 0; i < 100000; i++) LOG_ERROR_ARGS("rate limit test %d", i); // prints 3 records, drops the rest unformatted
+    AK::Log::Logger::flushSuppressed(); // prints "last message repeated 99997 times: rate limit test %d"
+    AK::Log::Logger::setRateLimit(0, 0);
+
+    log.info("template info test x={} y={} name={}", 1, 2.5, "akl"); // "{}" placeholders, formatted without printf
+    LOG_INFO_ARGS("checked %5.2f {}", 2.5, true); // checked at compile time, LOG_INFO_ARGS("%d", "text") does not build
+
+    log.info("large message test {}", std::string(8000, 'x').c_str()); // grows the record buffers into the thread's arena
+    log.info("large message test {}", std::string(8000, 'y').c_str()); // reuses the grown blocks, no heap allocation
+    AK::Log::ArenaStats arena = AK::Log::getArenaStats();
+    log.info("arena reserved={} in use={} high water={} mallocs={}", arena.reservedBytes, arena.inUseBytes, arena.highWaterBytes, arena.heapAllocations);
+
+    log.setTimePrecision(AK::Log::TimePrecision::PRECISION_MILLISECONDS);
+    log.logInfo("millisecond timestamp test"); // prints the time as HH:MM:SS.mmm
+    log.setLayout("%l %t | %s\n", L"%l %t | %s\n"); // safe while other threads log; Logger::watchConfig(path) reloads on SIGHUP
+    log.logInfo("layout swap test");
+    log.setLayout("[%l %d %t]: %s\n", L"[%l %d %t]: %s\n");
+
+    AK::Log::FileSink file("test.log", 1024 * 1024, 0, 3); // rolls over to test.log.1 .. test.log.3 every MiB
+    log.setSink(&file);
+    log.logInfo("file sink test");
+    log.setSink(nullptr); // back to the console
+
+    AK::Log::UringFileSink uring("test-uring.log"); // io_uring appends on Linux, a FileSink elsewhere
+    log.setSink(&uring);
+    log.info("io_uring sink test, uring {}", uring.usesUring());
+    log.setSink(nullptr);
+
+    #if !defined(_WIN32) && !defined(_WIN64)
+    AK::Log::MappedFileSink mapped("test-mapped.log", 1024 * 1024, 4); // copies into a shared mapping, at most 4 MiB
+    log.setSink(&mapped);
+    log.logInfo("mapped file sink test");
+    log.setSink(nullptr);
+    log.info("mapped file sink dropped {} bytes", mapped.droppedBytes());
+    #endif
+
+    AK::Log::ConsoleSink console;
+    AK::Log::FileSink plain("test-plain.log");
+    log.setSink(&console);
+    log.setSinkThreshold(&console, AK::Log::LEVEL_WARNING); // colored console at WARNING and above
+    log.addSink(&plain, AK::Log::LEVEL_INFO, "%d %t %l: %s\n", L"%d %t %l: %s\n", AK::Log::COLOR_AUTO); // plain file at INFO and above, no escapes
+    log.logInfo("multi sink test, file only");
+    log.logWarning("multi sink test, console and file"); // the message is formatted once for both layouts
+    log.removeSink(&plain);
+    log.addSink(&plain, AK::Log::LEVEL_INFO, AK::Log::OUTPUT_JSON); // one JSON object per record, OUTPUT_LOGFMT for logfmt lines
+    log.logKV(AK::Log::LEVEL_WARNING, "structured test", "latency_us", 1234, "status", 200, "path", "/index.html"); // the console prints the pairs as key=value
+    log.removeSink(&plain);
+    log.setSink(nullptr);
+
+    AK::Log::ConsoleSink batched({ 64 * 1024, 256, 10 }); // gathers records into one writev per batch, at most 10 ms late
+    log.setSink(&batched);
+    log.logInfo("batched console test");
+    log.setSink(nullptr);
+
+    WarningCounter counter;
+    log.setSink(&counter);
+    log.logWarning("counted, never formatted %s", "text");
+    log.setSink(nullptr);
+    log.info("warning counter test {}", counter.count);
+
+    log.startAsync(1024, AK::Log::OverflowPolicy::OVERFLOW_BLOCK);
+    log.logInfo("async info test %d", 1); // formatted and written by the writer thread
+    log.logInfoW(L"async wide info test %d", 2);
+    log.info("async template info test {}", 3);
+    log.flush(); // returns once both records above are on stdout
+    AK::Log::LoggerStats stats = AK::Log::Logger::stats(); // summed over every thread's counters on demand
+    log.info("stats info records={} sinks written={}", stats.emitted[AK::Log::LEVEL_INFO], stats.sinkCount); // queue fields describe Logger::get()'s queue
+    AK::Log::Logger::reportStats(AK::Log::LEVEL_INFO); // the same as one key/value record; startStatsReport(60, level) logs it every minute
+    log.stopAsync();
+
+    AK::Log::FileSink binary("test.aklb"); // decode with: akl-decode test.aklb
+    AK::Log::Logger::get()->setBinarySink(&binary);
+    LOG_INFO_ARGS_BINARY("binary info test %d %s %.2f", 42, "text", 3.14159); // only the format id and raw arguments are written
+    LOG_INFO_ARGS_WIDE_BINARY(L"binary wide info test %lc", 0x3C0);
+    AK::Log::Logger::get()->setBinarySink(nullptr);
 }
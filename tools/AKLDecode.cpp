@@ -0,0 +1,360 @@
+// akl-decode: renders a binary log stream written through Logger::setBinarySink as text.
+//
+// usage: akl-decode <file> [layout] [-ms|-us]
+//
+// The layout accepts the logger's %l, %d, %t and %s directives (colors and %m are ignored)
+// and defaults to "[%l %d %t]: %s\n".
+
+#include "../include/AKL/Binary.hpp"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+using namespace AK::Log;
+
+struct DecodedFormat
+{
+    bool defined;
+    bool wide;
+    std::vector<uint8_t> argTypes;
+    std::string text;
+};
+
+static const char* LEVEL_NAMES[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "ASSERT" };
+
+static bool readBytes(FILE* file, void* data, size_t size)
+{
+    return fread(data, 1, size, file) == size;
+}
+
+template<typename T>
+static bool readValue(const char*& cursor, const char* end, T& value)
+{
+    if ((size_t)(end - cursor) < sizeof(T)) return false;
+
+    memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return true;
+}
+
+static void appendFormatted(std::string& out, const char* spec, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, spec);
+    int length = vsnprintf(buffer, sizeof(buffer), spec, args);
+    va_end(args);
+
+    if (length < 0) return;
+    if ((size_t)length < sizeof(buffer))
+    {
+        out.append(buffer, length);
+        return;
+    }
+
+    std::vector<char> large(length + 1);
+    va_start(args, spec);
+    vsnprintf(large.data(), large.size(), spec, args);
+    va_end(args);
+    out.append(large.data(), length);
+}
+
+// Rebuilds each conversion of the original format as a narrow printf spec and feeds it the
+// value read from the payload. Strings and characters are already UTF-8 and print with %s.
+static bool renderMessage(const DecodedFormat& format, const char* cursor, const char* end, std::string& out)
+{
+    const std::string& text = format.text;
+    size_t argIndex = 0;
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] != '%')
+        {
+            out += text[i];
+            continue;
+        }
+
+        if (text[i + 1] == '%')
+        {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        ConversionSpec spec;
+        if (!parseConversion(text.c_str() + i, spec)) break;
+
+        std::string options = text.substr(i + spec.optionsStart, spec.optionsLength);
+        std::vector<int> stars;
+        i += spec.length - 1;
+
+        if (spec.widthStar || spec.precisionStar)
+        {
+            size_t count = (spec.widthStar ? 1 : 0) + (spec.precisionStar ? 1 : 0);
+            for (size_t j = 0; j < count; j++)
+            {
+                int32_t value;
+                if (argIndex >= format.argTypes.size() || !readValue(cursor, end, value)) return false;
+                stars.push_back(value);
+                argIndex++;
+            }
+        }
+
+        BinaryArgType type = conversionArgType(spec, format.wide);
+        if (type == ARG_NONE) continue;
+        if (argIndex >= format.argTypes.size()) return false;
+        argIndex++;
+
+        std::string conversion = "%" + options;
+        int star0 = stars.size() > 0 ? stars[0] : 0;
+        int star1 = stars.size() > 1 ? stars[1] : 0;
+
+        switch (type)
+        {
+            case ARG_INT32:
+            {
+                int32_t value;
+                if (!readValue(cursor, end, value)) return false;
+                if (spec.lengthModifier[0] == 'h') conversion += spec.lengthModifier;
+                conversion += spec.conversion;
+                if (stars.size() == 2) appendFormatted(out, conversion.c_str(), star0, star1, value);
+                else if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, value);
+                else appendFormatted(out, conversion.c_str(), value);
+                break;
+            }
+            case ARG_INT64:
+            {
+                int64_t value;
+                if (!readValue(cursor, end, value)) return false;
+                conversion += "ll";
+                conversion += spec.conversion;
+                if (stars.size() == 2) appendFormatted(out, conversion.c_str(), star0, star1, (long long)value);
+                else if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, (long long)value);
+                else appendFormatted(out, conversion.c_str(), (long long)value);
+                break;
+            }
+            case ARG_DOUBLE:
+            case ARG_LONG_DOUBLE:
+            {
+                double value;
+                if (!readValue(cursor, end, value)) return false;
+                conversion += spec.conversion;
+                if (stars.size() == 2) appendFormatted(out, conversion.c_str(), star0, star1, value);
+                else if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, value);
+                else appendFormatted(out, conversion.c_str(), value);
+                break;
+            }
+            case ARG_POINTER:
+            {
+                uint64_t value;
+                if (!readValue(cursor, end, value)) return false;
+                conversion += 'p';
+                if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, (void*)(uintptr_t)value);
+                else appendFormatted(out, conversion.c_str(), (void*)(uintptr_t)value);
+                break;
+            }
+            case ARG_CHAR:
+            case ARG_WCHAR:
+            {
+                uint32_t value;
+                if (!readValue(cursor, end, value)) return false;
+
+                char bytes[5];
+                if (type == ARG_CHAR) bytes[0] = (char)value, bytes[1] = '\0';
+                else bytes[encodeUtf8(value, bytes)] = '\0';
+
+                conversion += 's';
+                if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, bytes);
+                else appendFormatted(out, conversion.c_str(), bytes);
+                break;
+            }
+            case ARG_STRING:
+            case ARG_WSTRING:
+            {
+                uint32_t length;
+                if (!readValue(cursor, end, length)) return false;
+
+                std::string value = "(null)";
+                if (length != BINARY_NULL_STRING)
+                {
+                    if ((size_t)(end - cursor) < length) return false;
+                    value.assign(cursor, length);
+                    cursor += length;
+                }
+
+                conversion += 's';
+                if (stars.size() == 2) appendFormatted(out, conversion.c_str(), star0, star1, value.c_str());
+                else if (stars.size() == 1) appendFormatted(out, conversion.c_str(), star0, value.c_str());
+                else appendFormatted(out, conversion.c_str(), value.c_str());
+                break;
+            }
+            case ARG_IGNORED:
+            case ARG_NONE:
+                break;
+        }
+    }
+
+    return true;
+}
+
+static void renderTime(std::string& out, int64_t timestamp, bool date, int precision)
+{
+    time_t seconds = (time_t)(timestamp / 1000000);
+    struct tm local;
+    char buffer[32];
+
+    #if defined(_WIN32) || defined(_WIN64)
+    localtime_s(&local, &seconds);
+    #else
+    localtime_r(&seconds, &local);
+    #endif
+
+    if (date)
+    {
+        strftime(buffer, sizeof(buffer), "%Y/%m/%d", &local);
+        out += buffer;
+        return;
+    }
+
+    strftime(buffer, sizeof(buffer), "%H:%M:%S", &local);
+    out += buffer;
+
+    if (precision == 3) appendFormatted(out, ".%03d", (int)(timestamp % 1000000 / 1000));
+    else if (precision == 6) appendFormatted(out, ".%06d", (int)(timestamp % 1000000));
+}
+
+static std::string unescape(const char* layout)
+{
+    std::string out;
+
+    for (size_t i = 0; layout[i] != '\0'; i++)
+    {
+        if (layout[i] == '\\' && layout[i + 1] == 'n') out += '\n', i++;
+        else if (layout[i] == '\\' && layout[i + 1] == 't') out += '\t', i++;
+        else out += layout[i];
+    }
+
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <file> [layout] [-ms|-us]\n", argv[0]);
+        return 1;
+    }
+
+    std::string layout = "[%l %d %t]: %s\n";
+    int precision = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-ms") == 0) precision = 3;
+        else if (strcmp(argv[i], "-us") == 0) precision = 6;
+        else layout = unescape(argv[i]);
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "akl-decode: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    char magic[4];
+    uint8_t version;
+    if (!readBytes(file, magic, 4) || memcmp(magic, BINARY_MAGIC, 4) != 0 || !readBytes(file, &version, 1) || version != BINARY_VERSION)
+    {
+        fprintf(stderr, "akl-decode: %s is not a binary log (version %u)\n", argv[1], (unsigned)BINARY_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<DecodedFormat> formats;
+    std::vector<char> payload;
+    std::string line;
+    uint8_t entry;
+    int status = 0;
+
+    while (readBytes(file, &entry, 1))
+    {
+        if (entry == BINARY_ENTRY_FORMAT)
+        {
+            uint32_t id, length;
+            uint8_t wide, argCount;
+
+            if (!readBytes(file, &id, 4) || !readBytes(file, &wide, 1) || !readBytes(file, &argCount, 1) || id >= BINARY_MAX_FORMATS) break;
+            if (formats.size() <= id) formats.resize(id + 1);
+
+            DecodedFormat& format = formats[id];
+            format.defined = true;
+            format.wide = wide != 0;
+            format.argTypes.resize(argCount);
+
+            if (!readBytes(file, format.argTypes.data(), argCount) || !readBytes(file, &length, 4)) break;
+            format.text.resize(length);
+            if (!readBytes(file, &format.text[0], length)) break;
+        }
+        else if (entry == BINARY_ENTRY_RECORD)
+        {
+            uint8_t level;
+            uint32_t id, payloadSize;
+            int64_t timestamp;
+
+            if (!readBytes(file, &level, 1) || !readBytes(file, &id, 4) || !readBytes(file, &timestamp, 8) || !readBytes(file, &payloadSize, 4)) break;
+
+            payload.resize(payloadSize);
+            if (!readBytes(file, payload.data(), payloadSize)) break;
+
+            if (id >= formats.size() || !formats[id].defined)
+            {
+                fprintf(stderr, "akl-decode: record refers to unknown format %u\n", id);
+                status = 1;
+                continue;
+            }
+
+            std::string message;
+            if (!renderMessage(formats[id], payload.data(), payload.data() + payload.size(), message))
+            {
+                fprintf(stderr, "akl-decode: truncated payload for format %u\n", id);
+                status = 1;
+            }
+
+            line.clear();
+            for (size_t i = 0; i < layout.size(); i++)
+            {
+                if (layout[i] != '%' || i + 1 == layout.size())
+                {
+                    line += layout[i];
+                    continue;
+                }
+
+                switch (layout[++i])
+                {
+                    case 'l': line += level < 7 ? LEVEL_NAMES[level] : "UNKNOWN"; break;
+                    case 'd': renderTime(line, timestamp, true, precision); break;
+                    case 't': renderTime(line, timestamp, false, precision); break;
+                    case 's': line += message; break;
+                    default: break;
+                }
+            }
+
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        else
+        {
+            fprintf(stderr, "akl-decode: unknown entry 0x%02x\n", entry);
+            status = 1;
+            break;
+        }
+    }
+
+    fclose(file);
+    return status;
+}